@@ -20,6 +20,7 @@
 
 #include "general.h"
 #include "target.h"
+#include "crc32.h"
 #include "gdb_if.h"
 
 #if !defined(STM32F0) && !defined(STM32F1) && !defined(STM32F2) && \
@@ -98,6 +99,14 @@ static uint32_t crc32_calc(uint32_t crc, uint8_t data)
 	return (crc << 8) ^ crc32_table[((crc >> 24) ^ data) & 255];
 }
 
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+	const uint8_t *bytes = data;
+	for (size_t i = 0; i < len; i++)
+		crc = crc32_calc(crc, bytes[i]);
+	return crc;
+}
+
 int generic_crc32(target *t, uint32_t *crc_res, uint32_t base, size_t len)
 {
 	uint32_t crc = -1;
@@ -138,6 +147,21 @@ int generic_crc32(target *t, uint32_t *crc_res, uint32_t base, size_t len)
 }
 #else
 #include <libopencm3/stm32/crc.h>
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+	const uint8_t *bytes = data;
+	while (len--) {
+		crc ^= (uint32_t)*bytes++ << 24;
+		for (int i = 0; i < 8; i++) {
+			if (crc & 0x80000000)
+				crc = (crc << 1) ^ 0x4C11DB7;
+			else
+				crc <<= 1;
+		}
+	}
+	return crc;
+}
+
 int generic_crc32(target *t, uint32_t *crc_res, uint32_t base, size_t len)
 {
 	uint8_t bytes[128];
@@ -173,17 +197,7 @@ int generic_crc32(target *t, uint32_t *crc_res, uint32_t base, size_t len)
 				   base);
 		return -1;
 	}
-	uint8_t *data = bytes;
-	while (len--) {
-		crc ^= *data++ << 24;
-		for (int i = 0; i < 8; i++) {
-			if (crc & 0x80000000)
-				crc = (crc << 1) ^ 0x4C11DB7;
-			else
-				crc <<= 1;
-		}
-	}
-	*crc_res = crc;
+	*crc_res = crc32_update(crc, bytes, len);
 	return 0;
 }
 #endif
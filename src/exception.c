@@ -21,7 +21,11 @@
 #include "general.h"
 #include "exception.h"
 
+#if PC_HOSTED == 1
+_Thread_local struct exception *innermost_exception;
+#else
 struct exception *innermost_exception;
+#endif
 
 void raise_exception(uint32_t type, const char *msg)
 {
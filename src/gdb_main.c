@@ -38,6 +38,9 @@
 #ifdef ENABLE_RTT
 #include "rtt.h"
 #endif
+#if PC_HOSTED == 1
+#include "flash_pipeline.h"
+#endif
 
 #if defined(_WIN32) || defined(__CYGWIN__)
 #include <malloc.h>
@@ -52,7 +55,9 @@ enum gdb_signal {
 	GDB_SIGLOST = 29,
 };
 
+#if PC_HOSTED == 0
 #define BUF_SIZE	1024U
+#endif
 
 #define ERROR_IF_NO_TARGET()	\
 	if(!cur_target) { gdb_putpacketz("EFF"); break; }
@@ -63,7 +68,13 @@ typedef struct
 	void (*func)(const char *packet, size_t len);
 } cmd_executer;
 
+#if PC_HOSTED == 1
+static size_t pbuf_size = GDB_PACKET_SIZE_DEFAULT;
+static char *pbuf;
+#else
+static const size_t pbuf_size = BUF_SIZE;
 static char pbuf[BUF_SIZE + 1U];
+#endif
 
 static target *cur_target;
 static target *last_target;
@@ -74,6 +85,80 @@ static void handle_v_packet(char *packet, size_t len);
 static void handle_z_packet(char *packet, size_t len);
 static void handle_kill_target(void);
 
+/* Registers sent with every stop reply: sp, lr, pc and xpsr (cpsr on Cortex-A) */
+static const uint8_t expedited_regs[] = {13U, 14U, 15U, 16U};
+/* Program counter register number, the same on Cortex-M and Cortex-A */
+#define GDB_REG_PC 15
+
+/*
+ * Send a 'T' stop reply carrying the registers GDB asks for first on every stop,
+ * saving it a 'g' or several 'p' round trips. They come from a single batched
+ * register read, which also primes the register cache for any later 'g'.
+ */
+static void gdb_put_stop_reply(const int signal, const target_addr_t *const watch)
+{
+	char reply[80];
+	size_t offset = snprintf(reply, sizeof(reply), "T%02X", signal);
+	if (watch)
+		offset += snprintf(reply + offset, sizeof(reply) - offset, "watch:%08" PRIX32 ";", *watch);
+
+	const size_t regs_size = target_regs_size(cur_target);
+	if (regs_size) {
+		uint8_t regs[regs_size];
+		target_regs_read(cur_target, regs);
+		for (size_t i = 0; i < ARRAY_LENGTH(expedited_regs); ++i) {
+			const size_t reg = expedited_regs[i];
+			if ((reg + 1U) * 4U > regs_size)
+				break;
+			offset += snprintf(reply + offset, sizeof(reply) - offset, "%02X:", (unsigned)reg);
+			hexify(reply + offset, regs + reg * 4U, 4U);
+			offset += 8U;
+			reply[offset++] = ';';
+		}
+	}
+	gdb_putpacket(reply, offset);
+}
+
+/* Wait for the target to halt, servicing interrupt requests from GDB and RTT meanwhile */
+static enum target_halt_reason gdb_wait_for_halt(target_addr_t *const watch)
+{
+	enum target_halt_reason reason;
+	while (!(reason = target_halt_poll(cur_target, watch))) {
+		char c = (char)gdb_if_getchar_to(0);
+		if (c == '\x03' || c == '\x04')
+			target_halt_request(cur_target);
+		platform_pace_poll();
+#ifdef ENABLE_RTT
+		if (rtt_enabled)
+			poll_rtt(cur_target);
+#endif
+	}
+	SET_RUN_STATE(0);
+	return reason;
+}
+
+/* Translate a halt reason to a GDB signal and report it */
+static void gdb_put_halt_reason(const enum target_halt_reason reason, const target_addr_t *const watch)
+{
+	switch (reason) {
+	case TARGET_HALT_ERROR:
+		gdb_putpacket_f("X%02X", GDB_SIGLOST);
+		morse("TARGET LOST.", true);
+		break;
+	case TARGET_HALT_REQUEST:
+		gdb_put_stop_reply(GDB_SIGINT, NULL);
+		break;
+	case TARGET_HALT_WATCHPOINT:
+		gdb_put_stop_reply(GDB_SIGTRAP, watch);
+		break;
+	case TARGET_HALT_FAULT:
+		gdb_put_stop_reply(GDB_SIGSEGV, NULL);
+		break;
+	default:
+		gdb_put_stop_reply(GDB_SIGTRAP, NULL);
+	}
+}
+
 static void gdb_target_destroy_callback(struct target_controller *tc, target *t)
 {
 	(void)tc;
@@ -120,11 +205,16 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 	/* GDB protocol main loop */
 	while (1) {
 		SET_IDLE_STATE(1);
-		size_t size = gdb_getpacket(pbuf, BUF_SIZE);
+		size_t size = gdb_getpacket(pbuf, pbuf_size);
 		// If port closed and target detached, stay idle
 		if ((pbuf[0] != 0x04) || cur_target) {
 			SET_IDLE_STATE(0);
 		}
+#if PC_HOSTED == 1
+		/* Only further Flash writes may go ahead while queued ones are being programmed */
+		if (strncmp(pbuf, "vFlashWrite:", 12) != 0)
+			flash_pipeline_sync();
+#endif
 		switch(pbuf[0]) {
 		/* Implementation of these is mandatory! */
 		case 'g': { /* 'g': Read general registers */
@@ -138,7 +228,7 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 			uint32_t addr, len;
 			ERROR_IF_NO_TARGET();
 			sscanf(pbuf, "m%" SCNx32 ",%" SCNx32, &addr, &len);
-			if (len > sizeof(pbuf) / 2) {
+			if (len > pbuf_size / 2U) {
 				gdb_putpacketz("E02");
 				break;
 			}
@@ -151,6 +241,23 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 				gdb_putpacket(hexify(pbuf, mem, len), len * 2U);
 			break;
 		}
+		case 'x': {	/* 'x addr,len': Read len bytes from addr as binary data */
+			uint32_t addr, len;
+			ERROR_IF_NO_TARGET();
+			sscanf(pbuf, "x%" SCNx32 ",%" SCNx32, &addr, &len);
+			if (len > pbuf_size) {
+				gdb_putpacketz("E02");
+				break;
+			}
+			DEBUG_GDB("x packet: addr = %" PRIx32 ", len = %" PRIx32 "\n",
+					  addr, len);
+			/* The request has been parsed, so read straight into the packet buffer */
+			if (target_mem_read(cur_target, pbuf, addr, len))
+				gdb_putpacketz("E01");
+			else
+				gdb_putpacket2("b", 1U, pbuf, len);
+			break;
+		}
 		case 'G': {	/* 'G XX': Write general registers */
 			ERROR_IF_NO_TARGET();
 			uint8_t gp_regs[target_regs_size(cur_target)];
@@ -208,46 +315,15 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 		case '?': {	/* '?': Request reason for target halt */
 			/* This packet isn't documented as being mandatory,
 			 * but GDB doesn't work without it. */
-			target_addr_t watch;
-			enum target_halt_reason reason;
-
 			if (!cur_target) {
 				/* Report "target exited" if no target */
 				gdb_putpacketz("W00");
 				break;
 			}
 
-			/* Wait for target halt */
-			while(!(reason = target_halt_poll(cur_target, &watch))) {
-				char c = (char)gdb_if_getchar_to(0);
-				if(c == '\x03' || c == '\x04')
-					target_halt_request(cur_target);
-				platform_pace_poll();
-				#ifdef ENABLE_RTT
-				if (rtt_enabled)
-					poll_rtt(cur_target);
-				#endif
-			}
-			SET_RUN_STATE(0);
-
-			/* Translate reason to GDB signal */
-			switch (reason) {
-			case TARGET_HALT_ERROR:
-				gdb_putpacket_f("X%02X", GDB_SIGLOST);
-				morse("TARGET LOST.", true);
-				break;
-			case TARGET_HALT_REQUEST:
-				gdb_putpacket_f("T%02X", GDB_SIGINT);
-				break;
-			case TARGET_HALT_WATCHPOINT:
-				gdb_putpacket_f("T%02Xwatch:%08X;", GDB_SIGTRAP, watch);
-				break;
-			case TARGET_HALT_FAULT:
-				gdb_putpacket_f("T%02X", GDB_SIGSEGV);
-				break;
-			default:
-				gdb_putpacket_f("T%02X", GDB_SIGTRAP);
-			}
+			target_addr_t watch;
+			const enum target_halt_reason reason = gdb_wait_for_halt(&watch);
+			gdb_put_halt_reason(reason, &watch);
 			break;
 		}
 
@@ -297,6 +373,9 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 			break;
 
 		case 0x04:
+			/* The port was closed, so the next GDB starts out with acknowledgements */
+			gdb_set_noackmode(false);
+			/* fall through */
 		case 'D':	/* GDB 'detach' command. */
 			if(cur_target) {
 				SET_RUN_STATE(1);
@@ -343,6 +422,7 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 		}
 
 		case 'q':	/* General query packet */
+		case 'Q':	/* General set packet */
 			handle_q_packet(pbuf, size);
 			break;
 
@@ -426,7 +506,17 @@ static void exec_q_supported(const char *packet, const size_t length)
 {
 	(void)packet;
 	(void)length;
-	gdb_putpacket_f("PacketSize=%X;qXfer:memory-map:read+;qXfer:features:read+", BUF_SIZE);
+	gdb_putpacket_f("PacketSize=%X;qXfer:memory-map:read+;qXfer:features:read+;binary-upload+;QStartNoAckMode+",
+		(unsigned)pbuf_size);
+}
+
+static void exec_q_noackmode(const char *packet, const size_t length)
+{
+	(void)packet;
+	(void)length;
+	/* Switch before replying, GDB's acknowledgement of the OK is then skipped like any other stray '+' */
+	gdb_set_noackmode(true);
+	gdb_putpacketz("OK");
 }
 
 static void exec_q_memory_map(const char *packet, const size_t length)
@@ -474,7 +564,7 @@ static void exec_q_crc(const char *packet, const size_t length)
 			return;
 		}
 		uint32_t crc;
-		if (generic_crc32(cur_target, &crc, addr, addr_length))
+		if (target_mem_crc32(cur_target, &crc, addr, addr_length))
 			gdb_putpacketz("E03");
 		else
 			gdb_putpacket_f("C%lx", crc);
@@ -518,6 +608,7 @@ static const cmd_executer q_commands[]=
 	{"qC",                             exec_q_c},
 	{"qfThreadInfo",                   exec_q_thread_info},
 	{"qsThreadInfo",                   exec_q_thread_info},
+	{"QStartNoAckMode",                exec_q_noackmode},
 	{NULL, NULL},
 };
 
@@ -539,6 +630,65 @@ static void handle_q_packet(char *packet, const size_t length)
 	gdb_putpacket("", 0);
 }
 
+/*
+ * 'vCont;action[:thread-id][;action...]'. We only have the one thread, so the first
+ * action is the one that applies to it. For range stepping ('r start,end') we keep
+ * single stepping here while the PC stays inside [start, end) and only report the
+ * final stop, rather than have GDB drive every instruction step itself.
+ */
+static void handle_v_cont(const char *const packet)
+{
+	if (!cur_target) {
+		gdb_putpacketz("X1D");
+		return;
+	}
+
+	uint32_t range_start = 0;
+	uint32_t range_end = 0;
+	bool step;
+	switch (packet[0]) {
+	case 'c':
+	case 'C':
+		step = false;
+		break;
+	case 's':
+	case 'S':
+		step = true;
+		break;
+	case 'r':
+		if (sscanf(packet, "r%" SCNx32 ",%" SCNx32, &range_start, &range_end) != 2) {
+			gdb_putpacketz("E01");
+			return;
+		}
+		step = true;
+		break;
+	default:
+		gdb_putpacketz("E01");
+		return;
+	}
+
+	target_halt_resume(cur_target, step);
+	SET_RUN_STATE(1);
+	target_addr_t watch;
+	enum target_halt_reason reason = gdb_wait_for_halt(&watch);
+	while (reason == TARGET_HALT_STEPPING && range_start < range_end) {
+		uint32_t pc;
+		if (target_reg_read(cur_target, GDB_REG_PC, &pc, sizeof(pc)) != sizeof(pc) ||
+			pc < range_start || pc >= range_end)
+			break;
+		/* Let GDB interrupt a range step that never leaves its range */
+		const char c = (char)gdb_if_getchar_to(0);
+		if (c == '\x03' || c == '\x04') {
+			reason = TARGET_HALT_REQUEST;
+			break;
+		}
+		target_halt_resume(cur_target, true);
+		SET_RUN_STATE(1);
+		reason = gdb_wait_for_halt(&watch);
+	}
+	gdb_put_halt_reason(reason, &watch);
+}
+
 static void handle_v_packet(char *packet, const size_t plen)
 {
 	uint32_t addr = 0;
@@ -563,6 +713,12 @@ static void handle_v_packet(char *packet, const size_t plen)
 		} else
 			gdb_putpacketz("E01");
 
+	} else if (!strcmp(packet, "vCont?")) {
+		gdb_putpacketz("vCont;c;C;s;S;r");
+
+	} else if (!strncmp(packet, "vCont;", 6)) {
+		handle_v_cont(packet + 6);
+
 	} else if (!strncmp(packet, "vKill;", 6)) {
 		/* Kill the target - we don't actually care about the PID that follows "vKill;" */
 		handle_kill_target();
@@ -642,7 +798,14 @@ static void handle_v_packet(char *packet, const size_t plen)
 		/* Write Flash Memory */
 		const uint32_t count = plen - bin;
 		DEBUG_GDB("Flash Write %08" PRIX32 " %08" PRIX32 "\n", addr, count);
-		if (cur_target && target_flash_write(cur_target, addr, (void*)packet + bin, count))
+		bool result = false;
+#if PC_HOSTED == 1
+		if (flash_pipeline_enabled())
+			result = cur_target && flash_pipeline_write(cur_target, addr, (void*)packet + bin, count);
+		else
+#endif
+			result = cur_target && target_flash_write(cur_target, addr, (void*)packet + bin, count);
+		if (result)
 			gdb_putpacketz("OK");
 		else {
 			target_flash_complete(cur_target);
@@ -651,7 +814,13 @@ static void handle_v_packet(char *packet, const size_t plen)
 
 	} else if (!strcmp(packet, "vFlashDone")) {
 		/* Commit flash operations. */
-		if (target_flash_complete(cur_target))
+		bool result = true;
+#if PC_HOSTED == 1
+		/* Pick up failures of pipelined writes */
+		result = flash_pipeline_result();
+#endif
+		result &= target_flash_complete(cur_target);
+		if (result)
 			gdb_putpacketz("OK");
 		else
 			gdb_putpacketz("EFF");
@@ -695,7 +864,27 @@ static void handle_z_packet(char *packet, const size_t plen)
 		gdb_putpacketz("OK");
 }
 
+#if PC_HOSTED == 1
+void gdb_set_packet_size(size_t size)
+{
+	if (pbuf) {
+		DEBUG_WARN("GDB packet size can not be changed once the server is running\n");
+		return;
+	}
+	pbuf_size = MIN(MAX(size, GDB_PACKET_SIZE_MIN), GDB_PACKET_SIZE_MAX);
+}
+#endif
+
 void gdb_main(void)
 {
+#if PC_HOSTED == 1
+	if (!pbuf) {
+		pbuf = malloc(pbuf_size + 1U);
+		if (!pbuf) { /* malloc failed: heap exhaustion */
+			DEBUG_WARN("malloc: failed in %s\n", __func__);
+			exit(-1);
+		}
+	}
+#endif
 	gdb_main_loop(&gdb_controller, false);
 }
@@ -30,6 +30,17 @@
 
 #include <stdarg.h>
 
+/* Set once GDB has negotiated QStartNoAckMode over a reliable transport */
+static bool noackmode = false;
+
+void gdb_set_noackmode(const bool enable)
+{
+	/* Log only when the mode actually changes */
+	if (noackmode != enable)
+		DEBUG_GDB("%s NoAckMode\n", enable ? "Enabling" : "Disabling");
+	noackmode = enable;
+}
+
 size_t gdb_getpacket(char *packet, size_t size)
 {
 	unsigned char csum;
@@ -95,6 +106,37 @@ size_t gdb_getpacket(char *packet, size_t size)
 
 		offset = 0;
 		csum = 0;
+#if PC_HOSTED == 1
+		/* Capture packet data into buffer a received span at a time, unescaping in place */
+		bool escaped = false;
+		bool complete = false;
+		while (!complete) {
+			const size_t count = gdb_if_read_block(packet + offset, size - offset, '#', &complete);
+			if (!count && !complete) /* Out of buffer space or the connection dropped */
+				break;
+
+			size_t out = offset;
+			for (size_t i = offset; i < offset + count; ++i) {
+				const char c = packet[i];
+				csum += c;
+				if (c == '$') { /* Restart capture, a raw '$' is never escaped data */
+					out = 0;
+					csum = 0;
+					escaped = false;
+				} else if (escaped) {
+					packet[out++] = c ^ 0x20;
+					escaped = false;
+				} else if (c == '}') /* escaped char */
+					escaped = true;
+				else
+					packet[out++] = c;
+			}
+			offset = out;
+		}
+		/* On overflow or a dropped connection, discard the packet and look for the next */
+		if (!complete)
+			continue;
+#else
 		char c;
 		/* Capture packet data into buffer */
 		while ((c = (char)gdb_if_getchar()) != '#') {
@@ -117,18 +159,20 @@ size_t gdb_getpacket(char *packet, size_t size)
 			csum += c;
 			packet[offset++] = c;
 		}
+#endif
 		recv_csum[0] = (char)gdb_if_getchar();
 		recv_csum[1] = (char)gdb_if_getchar();
 		recv_csum[2] = 0;
 
-		/* return packet if checksum matches */
-		if (csum == strtol(recv_csum, NULL, 16))
+		/* return packet if checksum matches, there is no way to ask for a resend in NoAckMode */
+		if (noackmode || csum == strtol(recv_csum, NULL, 16))
 			break;
 
 		/* get here if checksum fails */
 		gdb_if_putchar('-', 1); /* send nack */
 	}
-	gdb_if_putchar('+', 1); /* send ack */
+	if (!noackmode)
+		gdb_if_putchar('+', 1); /* send ack */
 	packet[offset] = 0;
 
 #if PC_HOSTED == 1
@@ -145,80 +189,104 @@ size_t gdb_getpacket(char *packet, size_t size)
 	return offset;
 }
 
-static void gdb_next_char(char c, unsigned char *csum)
+static inline bool gdb_needs_escape(const char c)
+{
+	return c == '$' || c == '#' || c == '}' || c == '*';
+}
+
+/* Kept free of branches so the compiler can vectorise the summation of long clean runs */
+static uint8_t gdb_checksum(const char *const data, const size_t size)
 {
+	uint8_t csum = 0;
+	for (size_t i = 0; i < size; ++i)
+		csum += (uint8_t)data[i];
+	return csum;
+}
+
 #if PC_HOSTED == 1
-	if ((c >= 32) && (c < 127))
-		DEBUG_GDB_WIRE("%c", c);
-	else
-		DEBUG_GDB_WIRE("\\x%02X", c);
-#endif
-	if ((c == '$') || (c == '#') || (c == '}') || (c == '*')) {
-		gdb_if_putchar('}', 0);
-		gdb_if_putchar(c ^ 0x20, 0);
-		*csum += '}' + (c ^ 0x20);
+static void gdb_wire_dump(const char *const data, const size_t size)
+{
+	if ((cl_debuglevel & (BMP_DEBUG_GDB | BMP_DEBUG_WIRE)) != (BMP_DEBUG_GDB | BMP_DEBUG_WIRE))
+		return;
+	for (size_t i = 0; i < size; ++i) {
+		const char c = data[i];
+		if ((c >= 32) && (c < 127))
+			DEBUG_GDB_WIRE("%c", c);
+		else
+			DEBUG_GDB_WIRE("\\x%02X", c);
 	}
-	else {
-		gdb_if_putchar(c, 0);
-		*csum += c;
+}
+#endif
+
+/*
+ * Hand a packet body to the interface, copying runs that need no escaping as
+ * whole blocks and only breaking them up for the escape sequences.
+ * Returns the checksum updated with the bytes as sent on the wire.
+ */
+static uint8_t gdb_put_escaped(const char *const data, const size_t size, uint8_t csum)
+{
+#if PC_HOSTED == 1
+	gdb_wire_dump(data, size);
+#endif
+	size_t offset = 0;
+	while (offset < size) {
+		size_t run_end = offset;
+		while (run_end < size && !gdb_needs_escape(data[run_end]))
+			++run_end;
+
+		if (run_end != offset) {
+			gdb_if_write(data + offset, run_end - offset, 0);
+			csum += gdb_checksum(data + offset, run_end - offset);
+		}
+		if (run_end == size)
+			break;
+
+		const char escaped[2] = {'}', (char)(data[run_end] ^ 0x20)};
+		gdb_if_write(escaped, sizeof(escaped), 0);
+		csum += gdb_checksum(escaped, sizeof(escaped));
+		offset = run_end + 1U;
 	}
+	return csum;
+}
+
+static void gdb_put_frame(const char start, const char *const packet1, const size_t size1, const char *const packet2,
+	const size_t size2)
+{
+	gdb_if_write(&start, 1U, 0);
+	uint8_t csum = gdb_put_escaped(packet1, size1, 0);
+	csum = gdb_put_escaped(packet2, size2, csum);
+
+	char trailer[4] = {'#'};
+	hexify(trailer + 1, &csum, 1U);
+	gdb_if_write(trailer, 3U, 1);
 }
 
 void gdb_putpacket2(const char *packet1, size_t size1, const char *packet2, size_t size2)
 {
-	char xmit_csum[3];
 	size_t tries = 0;
 
 	do {
 		DEBUG_GDB_WIRE("%s: ", __func__);
-		unsigned char csum = 0;
-		gdb_if_putchar('$', 0);
-
-		for (size_t i = 0; i < size1; ++i)
-			gdb_next_char(packet1[i], &csum);
-		for (size_t i = 0; i < size2; ++i)
-			gdb_next_char(packet2[i], &csum);
-
-		gdb_if_putchar('#', 0);
-		snprintf(xmit_csum, sizeof(xmit_csum), "%02X", csum);
-		gdb_if_putchar(xmit_csum[0], 0);
-		gdb_if_putchar(xmit_csum[1], 1);
+		gdb_put_frame('$', packet1, size1, packet2, size2);
 		DEBUG_GDB_WIRE("\n");
-	} while (gdb_if_getchar_to(2000) != '+' && tries++ < 3);
+	} while (!noackmode && gdb_if_getchar_to(2000) != '+' && tries++ < 3);
 }
 
 void gdb_putpacket(const char *packet, size_t size)
 {
-	char xmit_csum[3];
 	size_t tries = 0;
 
 	do {
 		DEBUG_GDB_WIRE("%s: ", __func__);
-		unsigned char csum = 0;
-		gdb_if_putchar('$', 0);
-		for (size_t i = 0; i < size; ++i)
-			gdb_next_char(packet[i], &csum);
-		gdb_if_putchar('#', 0);
-		snprintf(xmit_csum, sizeof(xmit_csum), "%02X", csum);
-		gdb_if_putchar(xmit_csum[0], 0);
-		gdb_if_putchar(xmit_csum[1], 1);
+		gdb_put_frame('$', packet, size, NULL, 0);
 		DEBUG_GDB_WIRE("\n");
-	} while (gdb_if_getchar_to(2000) != '+' && tries++ < 3);
+	} while (!noackmode && gdb_if_getchar_to(2000) != '+' && tries++ < 3);
 }
 
 void gdb_put_notification(const char *const packet, const size_t size)
 {
-	char xmit_csum[3];
-
 	DEBUG_GDB_WIRE("%s: ", __func__);
-	uint8_t csum = 0;
-	gdb_if_putchar('%', 0);
-	for (size_t i = 0; i < size; ++i)
-		gdb_next_char(packet[i], &csum);
-	gdb_if_putchar('#', 0);
-	snprintf(xmit_csum, sizeof(xmit_csum), "%02X", csum);
-	gdb_if_putchar(xmit_csum[0], 0);
-	gdb_if_putchar(xmit_csum[1], 1);
+	gdb_put_frame('%', packet, size, NULL, 0);
 	DEBUG_GDB_WIRE("\n");
 }
 
@@ -235,8 +303,21 @@ void gdb_putpacket_f(const char *fmt, ...)
 	va_end(ap);
 }
 
+#if PC_HOSTED == 1
+static _Thread_local bool gdb_out_muted;
+
+void gdb_out_mute(const bool mute)
+{
+	gdb_out_muted = mute;
+}
+#endif
+
 void gdb_out(const char *buf)
 {
+#if PC_HOSTED == 1
+	if (gdb_out_muted)
+		return;
+#endif
 	int l = strlen(buf);
 	char *hexdata = calloc(1, 2 * l + 1);
 	if (!hexdata)
@@ -21,6 +21,8 @@
 #ifndef INCLUDE_CRC32_H
 #define INCLUDE_CRC32_H
 
-int generic_crc32(target *t, uint32_t *crc, uint32_t base, int len);
+int generic_crc32(target *t, uint32_t *crc, uint32_t base, size_t len);
+/* Continue a CRC-32 as GDB's qCRC defines it over a host buffer, start from 0xffffffff */
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len);
 
 #endif /* INCLUDE_CRC32_H */
@@ -58,7 +58,12 @@ struct exception {
 	struct exception *outer;
 };
 
+#if PC_HOSTED == 1
+/* Per thread, the hosted Flash pipeline worker raises exceptions of its own */
+extern _Thread_local struct exception *innermost_exception;
+#else
 extern struct exception *innermost_exception;
+#endif
 
 #define TRY_CATCH(e, type_mask) \
 	(e).type = 0; \
@@ -29,8 +29,20 @@ void gdb_usb_out_cb(usbd_device *dev, uint8_t ep);
 int gdb_if_init(void);
 unsigned char gdb_if_getchar(void);
 unsigned char gdb_if_getchar_to(int timeout);
+#if PC_HOSTED == 1
+/*
+ * Copy up to len received bytes, stopping at the first delim. If the delim is reached it
+ * is consumed and *found set. Only waits for data if nothing is buffered. Returns the
+ * number of bytes copied, 0 with *found clear once the connection drops.
+ */
+size_t gdb_if_read_block(char *buf, size_t len, char delim, bool *found);
+/* Sleep until data arrives from GDB or the timeout (in ms) expires, whichever comes first */
+void gdb_if_wait(uint32_t timeout);
+#endif
 
 /* sending gdb_if_putchar(0, true) seems to work as keep alive */
 void gdb_if_putchar(unsigned char c, int flush);
+/* Queue a block of bytes for sending, flushing the interface afterwards if requested */
+void gdb_if_write(const void *buf, size_t len, int flush);
 
 #endif /* INCLUDE_GDB_IF_H */
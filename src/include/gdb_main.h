@@ -22,5 +22,14 @@
 #define INCLUDE_GDB_MAIN_H
 
 void gdb_main(void);
+#if PC_HOSTED == 1
+/* The hosted packet buffer lives on the heap and can be sized from the command line */
+#define GDB_PACKET_SIZE_DEFAULT 16384U
+#define GDB_PACKET_SIZE_MIN     1024U
+#define GDB_PACKET_SIZE_MAX     65536U
+
+/* Set the size of the packet buffer advertised to GDB, must be called before gdb_main() */
+void gdb_set_packet_size(size_t size);
+#endif
 
 #endif /* INCLUDE_GDB_MAIN_H */
@@ -23,7 +23,9 @@
 
 #include <stddef.h>
 #include <stdarg.h>
+#include <stdbool.h>
 
+void gdb_set_noackmode(bool enable);
 size_t gdb_getpacket(char *packet, size_t size);
 void gdb_putpacket(const char *packet, size_t size);
 void gdb_putpacket2(const char *packet1, size_t size1, const char *packet2, size_t size2);
@@ -35,5 +37,9 @@ void gdb_put_notification(const char *packet, size_t size);
 void gdb_out(const char *buf);
 void gdb_voutf(const char *fmt, va_list);
 void gdb_outf(const char *fmt, ...);
+#if PC_HOSTED == 1
+/* Drop console output from the calling thread, for threads that do not own the GDB link */
+void gdb_out_mute(bool mute);
+#endif
 
 #endif /* INCLUDE_GDB_PACKET_H */
@@ -59,10 +59,30 @@ bool target_mem_map(target *t, char *buf, size_t len);
 int target_mem_read(target *t, void *dest, target_addr_t src, size_t len);
 int target_mem_write(target *t, target_addr_t dest, const void *src, size_t len);
 bool target_mem_access_needs_halt(target *t);
+int target_mem_crc32(target *t, uint32_t *crc, target_addr_t addr, size_t len);
 /* Flash memory access functions */
 bool target_flash_erase(target *t, target_addr_t addr, size_t len);
 bool target_flash_write(target *t, target_addr_t dest, const void *src, size_t len);
 bool target_flash_complete(target *t);
+bool target_flash_verify(target *t, target_addr_t addr, const void *data, size_t len);
+void target_flash_set_incremental(target *t, bool enable);
+
+/* Where the time of the last Flash session went, reset when entering Flash mode */
+typedef struct target_flash_stats {
+	uint32_t prepare_ms;       /* Unlocking and setting up the Flash controllers */
+	uint32_t erase_ms;         /* Erasing, including waiting on background erases */
+	uint32_t write_ms;         /* Programming buffered data */
+	uint32_t done_ms;          /* Finishing up and locking the Flash controllers */
+	uint32_t erase_calls;      /* Erase commands issued to the drivers */
+	uint32_t write_calls;      /* Write chunks handed to the drivers or the loader */
+	uint32_t bytes_written;    /* Bytes programmed */
+	uint32_t bytes_blank;      /* Bytes left unprogrammed as they hold the erased value */
+	uint32_t blocks_unchanged; /* Blocks skipped by the incremental mode */
+	uint32_t transactions;     /* Target memory accesses made through the target layer */
+	uint32_t status_polls;     /* Reads of a Flash controller's status while waiting on it */
+} target_flash_stats_s;
+
+const target_flash_stats_s *target_flash_stats(target *t);
 
 /* Register access functions */
 size_t target_regs_size(target *t);
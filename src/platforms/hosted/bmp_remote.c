@@ -375,6 +375,95 @@ static void remote_ap_mem_write_sized(
 	}
 }
 
+/* Sequence tag of the next binary packet */
+static uint8_t remote_tag;
+
+/*
+ * Collect the answer to the oldest outstanding binary packet, false if the
+ * probe reported a failure. A broken link is fatal, as for the SWD packets.
+ */
+static bool remote_binary_response(ADIv5_AP_t *ap, void *dest, size_t count, uint8_t expected, uint32_t addr)
+{
+	uint8_t tag = 0;
+	const int s = platform_buffer_read_binary(dest, count, &tag);
+	/* Without a tagged answer the stream cannot be brought back in step */
+	if (s != REMOTE_RESP_OK && s != REMOTE_RESP_ERR) {
+		DEBUG_WARN("Remote error %d around address 0x%08" PRIx32 "\n", s, addr);
+		exit(-1);
+	}
+	if (tag != expected) {
+		DEBUG_WARN("Remote answer out of step, tag %02x instead of %02x\n", tag, expected);
+		exit(-1);
+	}
+	if (s == REMOTE_RESP_OK)
+		return true;
+	ap->dp->fault = 1;
+	DEBUG_WARN("Remote returned REMOTE_RESP_ERR at apsel %d, addr: 0x%08" PRIx32 "\n", ap->apsel, addr);
+	return false;
+}
+
+/*
+ * As remote_ap_mem_read(), with the data coming back as raw bytes. Up to
+ * REMOTE_MAX_OUTSTANDING chunks are requested ahead of their answers.
+ */
+static void remote_ap_mem_read_binary(
+	ADIv5_AP_t *ap, void *dest, uint32_t src, size_t len)
+{
+	char construct[REMOTE_MAX_MSG_SIZE];
+	const uint8_t first_tag = remote_tag;
+	size_t requested = 0;
+	size_t received = 0;
+	bool failed = false;
+	while (received < requested || (!failed && received < len)) {
+		while (!failed && requested < len && requested - received < REMOTE_MAX_OUTSTANDING * REMOTE_BINARY_MAX) {
+			const size_t count = MIN(len - requested, REMOTE_BINARY_MAX);
+			const int s = snprintf(construct, REMOTE_MAX_MSG_SIZE, REMOTE_AP_MEM_READ_BIN_STR,
+				ap->dp->dp_jd_index, ap->apsel, ap->csw, src + (uint32_t)requested, (uint32_t)count, remote_tag++);
+			platform_buffer_write((uint8_t *)construct, s);
+			requested += count;
+		}
+		/* Answers after a failure are still collected, to stay in step */
+		const size_t count = MIN(len - received, REMOTE_BINARY_MAX);
+		const uint8_t expected = first_tag + received / REMOTE_BINARY_MAX;
+		if (!remote_binary_response(ap, (uint8_t *)dest + received, count, expected, src + received))
+			failed = true;
+		received += count;
+	}
+}
+
+/*
+ * As remote_ap_mem_write_sized(), with the data sent as raw bytes after the
+ * header. Up to REMOTE_MAX_OUTSTANDING chunks are sent ahead of their answers.
+ */
+static void remote_ap_mem_write_sized_binary(
+	ADIv5_AP_t *ap, uint32_t dest, const void *src, size_t len,
+	enum align align)
+{
+	uint8_t construct[REMOTE_MAX_MSG_SIZE + REMOTE_BINARY_MAX];
+	const uint8_t first_tag = remote_tag;
+	size_t sent = 0;
+	size_t answered = 0;
+	bool failed = false;
+	while (answered < sent || (!failed && answered < len)) {
+		while (!failed && sent < len && sent - answered < REMOTE_MAX_OUTSTANDING * REMOTE_BINARY_MAX) {
+			const size_t count = MIN(len - sent, REMOTE_BINARY_MAX);
+			const int s = snprintf((char *)construct, REMOTE_MAX_MSG_SIZE, REMOTE_AP_MEM_WRITE_BIN_STR,
+				ap->dp->dp_jd_index, ap->apsel, ap->csw, align, dest + (uint32_t)sent, (uint32_t)count,
+				remote_tag++);
+			memcpy(construct + s, (const uint8_t *)src + sent, count);
+			/* Keep the wire debug output, which prints the buffer as a string, in bounds */
+			construct[s + count] = 0;
+			platform_buffer_write(construct, s + count);
+			sent += count;
+		}
+		const size_t count = MIN(len - answered, REMOTE_BINARY_MAX);
+		const uint8_t expected = first_tag + answered / REMOTE_BINARY_MAX;
+		if (!remote_binary_response(ap, NULL, 0, expected, dest + answered))
+			failed = true;
+		answered += count;
+	}
+}
+
 void remote_adiv5_dp_defaults(ADIv5_DP_t *dp)
 {
 	uint8_t construct[REMOTE_MAX_MSG_SIZE];
@@ -382,8 +471,9 @@ void remote_adiv5_dp_defaults(ADIv5_DP_t *dp)
 		REMOTE_HL_CHECK_STR);
 	platform_buffer_write(construct, s);
 	s = platform_buffer_read(construct, REMOTE_MAX_MSG_SIZE);
-	if (s < 1 || construct[0] == REMOTE_RESP_ERR ||
-		construct[1] - '0' < REMOTE_HL_VERSION) {
+	const uint32_t version = s > 1 && construct[0] == REMOTE_RESP_OK ?
+		remotehston(-1, (char *)&construct[1]) : 0;
+	if (version < REMOTE_HL_VERSION_MIN) {
 		DEBUG_WARN("Please update BMP firmware for substantial speed increase!\n");
 		return;
 	}
@@ -391,8 +481,14 @@ void remote_adiv5_dp_defaults(ADIv5_DP_t *dp)
 	dp->dp_read    = remote_adiv5_dp_read;
 	dp->ap_write   = remote_adiv5_ap_write;
 	dp->ap_read    = remote_adiv5_ap_read;
-	dp->mem_read   = remote_ap_mem_read;
-	dp->mem_write_sized = remote_ap_mem_write_sized;
+	if (version >= REMOTE_HL_VERSION_BINARY) {
+		dp->mem_read   = remote_ap_mem_read_binary;
+		dp->mem_write_sized = remote_ap_mem_write_sized_binary;
+	} else {
+		DEBUG_WARN("BMP firmware has no binary memory transfers, update it for faster transfers\n");
+		dp->mem_read   = remote_ap_mem_read;
+		dp->mem_write_sized = remote_ap_mem_write_sized;
+	}
 }
 
 void remote_add_jtag_dev(uint32_t i, const jtag_dev_t *jtag_dev)
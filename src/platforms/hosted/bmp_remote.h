@@ -29,6 +29,12 @@
 
 int platform_buffer_write(const uint8_t *data, int size);
 int platform_buffer_read(uint8_t *data, int size);
+/*
+ * Read the response to a binary packet, storing its sequence tag in tag. An OK
+ * response carries exactly size raw bytes, which are stored in data.
+ * Returns the response code, negative on failure.
+ */
+int platform_buffer_read_binary(uint8_t *data, int size, uint8_t *tag);
 
 int remote_init(void);
 int remote_swdptap_init(ADIv5_DP_t *dp);
@@ -33,6 +33,7 @@
 #include "target_internal.h"
 #include "cortexm.h"
 #include "command.h"
+#include "gdb_main.h"
 
 #include "cli.h"
 #include "bmp_hosted.h"
@@ -135,7 +136,7 @@ static void cl_help(char **argv)
 		"\n"
 		"Usage: %s [-h | -l | [-vBITMASK] [-d PATH | -P NUMBER | -s SERIAL | -c TYPE]\n"
 		"\t[-n NUMBER] [-j | -A] [-C] [-t | -T] [-e] [-p] [-R[h]] [-H] [-M STRING ...]\n"
-		"\t[-f | -m] [-E | -w | -V | -r] [-a ADDR] [-S number] [file]]\n"
+		"\t[-b SIZE] [-f | -m] [-E | -w | -V | -r] [-i] [-a ADDR] [-S number] [file]]\n"
 		"\n"
 		"The default is to start a debug server at localhost:2000\n\n"
 		"Single-shot and verbosity options [-h | -l | -vBITMASK]:\n"
@@ -153,7 +154,7 @@ static void cl_help(char **argv)
 		"\t                   type (cable)\n"
 		"\n"
 		"General configuration options: [-n NUMBER] [-j] [-C] [-t | -T] [-e] [-p] [-R[h]]\n"
-		"\t\t[-H] [-M STRING ...]\n"
+		"\t\t[-H] [-M STRING ...] [-q]\n"
 		"\t-n, --number     Select the target device at the given position in the\n"
 		"\t                   scan chain (use the -t option to get a scan chain listing)\n"
 		"\t-j, --jtag       Use JTAG instead of SWD\n"
@@ -175,6 +176,10 @@ static void cl_help(char **argv)
 		"\t                   can be repeated for as many commands you wish to run.\n"
 		"\t                   If the command contains spaces, use quotes around the\n"
 		"\t                   complete command\n"
+		"\t-b, --packet-size Size of the GDB packet buffer offered to GDB, optionally\n"
+		"\t                   followed by 'k' (%uk to %uk, default %uk)\n"
+		"\t-q, --flash-pipeline Acknowledge GDB's Flash writes once queued and program\n"
+		"\t                   them in the background, errors show at the next write\n"
 		"\n"
 		"SWD-specific configuration options [-f FREQUENCY | -m TARGET]:\n"
 		"\t-f, --freq       Set an operating frequency for SWD\n"
@@ -188,13 +193,15 @@ static void cl_help(char **argv)
 		"\t                   binary file\n"
 		"\t-r, --read       Read the target device Flash\n"
 		"\n"
-		"Flash operation modifiers options: [-a ADDR] [-S number] [FILE]\n"
+		"Flash operation modifiers options: [-i] [-a ADDR] [-S number] [FILE]\n"
+		"\t-i, --incremental Only erase and write the Flash blocks whose contents\n"
+		"\t                   differ from the file\n"
 		"\t-a, --addr       Start address for the given Flash operation (defaults to\n"
 		"\t                   the start of Flash)\n"
 		"\t-S, --byte-count Number of bytes to work on in the Flash operation (default\n"
 		"\t                   is till the operation fails or is complete)\n"
 		"\t<file>           Binary file to use in Flash operations\n",
-		argv[0]
+		argv[0], GDB_PACKET_SIZE_MIN / 1024U, GDB_PACKET_SIZE_MAX / 1024U, GDB_PACKET_SIZE_DEFAULT / 1024U
 	);
 	exit(0);
 }
@@ -219,12 +226,15 @@ static const struct option long_options[] = {
 	{"reset", optional_argument, NULL, 'R'},
 	{"high-level", no_argument, NULL, 'H'},
 	{"monitor", required_argument, NULL, 'M'},
+	{"packet-size", required_argument, NULL, 'b'},
+	{"flash-pipeline", no_argument, NULL, 'q'},
 	{"freq", required_argument, NULL, 'f'},
 	{"multi-drop", required_argument, NULL, 'm'},
 	{"erase", no_argument, NULL, 'E'},
 	{"write", no_argument, NULL, 'W'},
 	{"verify", no_argument, NULL, 'V'},
 	{"read", no_argument, NULL, 'r'},
+	{"incremental", no_argument, NULL, 'i'},
 	{"addr", required_argument, NULL, 'a'},
 	{"byte-count", required_argument, NULL, 'S'},
 	{NULL, 0, NULL, 0}
@@ -236,10 +246,11 @@ void cl_init(BMP_CL_OPTIONS_t *opt, int argc, char **argv)
 	opt->opt_target_dev = 1;
 	opt->opt_flash_size = 0xffffffff;
 	opt->opt_flash_start = 0xffffffff;
+	opt->opt_packet_size = GDB_PACKET_SIZE_DEFAULT;
 	opt->opt_max_swj_frequency = 4000000;
 	opt->opt_scanmode = BMP_SCAN_SWD;
 	opt->opt_mode = BMP_MODE_DEBUG;
-	while((c = getopt_long(argc, argv, "eEFhHv:d:f:s:I:c:Cln:m:M:wVtTa:S:jApP:rR::", long_options, NULL)) != -1) {
+	while((c = getopt_long(argc, argv, "b:eEFhHiqv:d:f:s:I:c:Cln:m:M:wVtTa:S:jApP:rR::", long_options, NULL)) != -1) {
 		switch(c) {
 		case 'c':
 			if (optarg)
@@ -318,6 +329,12 @@ void cl_init(BMP_CL_OPTIONS_t *opt, int argc, char **argv)
 			else
 				opt->opt_mode = BMP_MODE_FLASH_WRITE;
 			break;
+		case 'i':
+			opt->opt_flash_incremental = true;
+			break;
+		case 'q':
+			opt->opt_flash_pipeline = true;
+			break;
 		case 'V':
 			if (opt->opt_mode == BMP_MODE_FLASH_WRITE)
 				opt->opt_mode = BMP_MODE_FLASH_WRITE_VERIFY;
@@ -356,6 +373,25 @@ void cl_init(BMP_CL_OPTIONS_t *opt, int argc, char **argv)
 			if (optarg)
 				opt->opt_position = atoi(optarg);
 			break;
+		case 'b':
+			if (optarg) {
+				char *endptr;
+				errno = 0;
+				unsigned long size = strtoul(optarg, &endptr, 0);
+				/* Only a plain number, optionally in kibibytes */
+				if (endptr[0] == 'k' && size <= GDB_PACKET_SIZE_MAX / 1024U) {
+					size *= 1024U;
+					++endptr;
+				}
+				if (!isdigit((unsigned char)optarg[0]) || errno || endptr[0] != '\0' ||
+					size < GDB_PACKET_SIZE_MIN || size > GDB_PACKET_SIZE_MAX) {
+					DEBUG_WARN("Invalid packet size \"%s\", expected %uk to %uk\n", optarg,
+						GDB_PACKET_SIZE_MIN / 1024U, GDB_PACKET_SIZE_MAX / 1024U);
+					exit(1);
+				}
+				opt->opt_packet_size = size;
+			}
+			break;
 		case 'S':
 			if (optarg) {
 				char *endptr;
@@ -556,7 +592,7 @@ found_targets:
 		target_reset(t);
 	} else if (opt->opt_mode == BMP_MODE_FLASH_ERASE) {
 		DEBUG_INFO("Erase %zu bytes at 0x%08" PRIx32 "\n", opt->opt_flash_size, opt->opt_flash_start);
-		if (!target_flash_erase(t, opt->opt_flash_start, opt->opt_flash_size)) {
+		if (!target_flash_erase(t, opt->opt_flash_start, opt->opt_flash_size) || !target_flash_complete(t)) {
 			DEBUG_WARN("Erasure failed!\n");
 			res = -1;
 			goto free_map;
@@ -565,6 +601,7 @@ found_targets:
 	} else if ((opt->opt_mode == BMP_MODE_FLASH_WRITE) || (opt->opt_mode == BMP_MODE_FLASH_WRITE_VERIFY)) {
 		DEBUG_INFO("Erase    %zu bytes at 0x%08" PRIx32 "\n", map.size, opt->opt_flash_start);
 		uint32_t start_time = platform_time_ms();
+		target_flash_set_incremental(t, opt->opt_flash_incremental);
 		if (!target_flash_erase(t, opt->opt_flash_start, map.size)) {
 			DEBUG_WARN("Erasure failed!\n");
 			res = -1;
@@ -583,11 +620,29 @@ found_targets:
 		uint32_t end_time = platform_time_ms();
 		DEBUG_WARN("Flash Write succeeded for %d bytes, %8.3f kiB/s\n",
 			   (int)map.size, (((map.size * 1.0)/(end_time - start_time))));
+		const target_flash_stats_s *const stats = target_flash_stats(t);
+		DEBUG_WARN("Prepare %" PRIu32 " ms, erase %" PRIu32 " ms (%" PRIu32 " erases), write %" PRIu32
+			   " ms (%" PRIu32 " bytes), done %" PRIu32 " ms, %" PRIu32 " transactions, %" PRIu32 " polls\n",
+			   stats->prepare_ms, stats->erase_ms, stats->erase_calls, stats->write_ms, stats->bytes_written,
+			   stats->done_ms, stats->transactions, stats->status_polls);
 		if (opt->opt_mode != BMP_MODE_FLASH_WRITE_VERIFY) {
 			target_reset(t);
 			goto free_map;
 		}
 	}
+	if ((opt->opt_mode == BMP_MODE_FLASH_VERIFY) ||
+	    (opt->opt_mode == BMP_MODE_FLASH_WRITE_VERIFY)) {
+		/* Compare CRCs first, only reading back to locate a mismatch */
+		uint32_t start_time = platform_time_ms();
+		if (target_flash_verify(t, opt->opt_flash_start, map.data, map.size)) {
+			uint32_t end_time = platform_time_ms();
+			DEBUG_WARN("Verify succeeded for %zu bytes in %" PRIu32 " ms\n", map.size, end_time - start_time);
+			if (opt->opt_mode == BMP_MODE_FLASH_WRITE_VERIFY)
+				target_reset(t);
+			goto free_map;
+		}
+		DEBUG_WARN("CRC mismatch, reading back to find the difference\n");
+	}
 	if ((opt->opt_mode == BMP_MODE_FLASH_READ) ||
 	    (opt->opt_mode == BMP_MODE_FLASH_VERIFY) ||
 	    (opt->opt_mode == BMP_MODE_FLASH_WRITE_VERIFY)) {
@@ -55,6 +55,8 @@ typedef struct BMP_CL_OPTIONS_s {
 	bool external_resistor_swd;
 	bool fast_poll;
 	bool opt_no_hl;
+	bool opt_flash_incremental;
+	bool opt_flash_pipeline;
 	char *opt_flash_file;
 	char *opt_device;
 	char *opt_serial;
@@ -68,6 +70,7 @@ typedef struct BMP_CL_OPTIONS_s {
 	uint32_t opt_flash_start;
 	uint32_t opt_max_swj_frequency;
 	size_t opt_flash_size;
+	size_t opt_packet_size;
 } BMP_CL_OPTIONS_t;
 
 void cl_init(BMP_CL_OPTIONS_t *opt, int argc, char **argv);
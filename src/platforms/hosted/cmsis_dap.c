@@ -435,6 +435,7 @@ void dap_adiv5_dp_defaults(ADIv5_DP_t *dp)
 		return;
 	dp->ap_read  = dap_ap_read;
 	dp->ap_write = dap_ap_write;
+	dp->queue_flush = dap_queue_flush;
 	dp->mem_read = dap_mem_read;
 	dp->mem_write_sized =  dap_mem_write_sized;
 }
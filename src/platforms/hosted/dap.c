@@ -616,6 +616,88 @@ void dap_ap_write(ADIv5_AP_t *ap, uint16_t addr, uint32_t value)
 	}
 }
 
+/* One request of a DAP_Transfer, queued accesses expand to these plus SELECT writes */
+typedef struct dap_transfer {
+	uint8_t request;
+	uint32_t value;
+	uint32_t *result;
+} dap_transfer_s;
+
+static void dap_transfer_run(ADIv5_DP_t *dp, const dap_transfer_s *const transfers, const size_t count)
+{
+	size_t index = 0;
+	while (index < count) {
+		uint8_t buf[63];
+		buf[0] = ID_DAP_TRANSFER;
+		buf[1] = dp->dp_jd_index;
+		size_t len = 3;
+		size_t reads = 0;
+		size_t requests = 0;
+		/* Pack as many requests as fit in both the command and its response */
+		for (; index + requests < count; ++requests) {
+			const dap_transfer_s *const transfer = &transfers[index + requests];
+			const bool read = transfer->request & DAP_TRANSFER_RnW;
+			if (len + (read ? 1U : 5U) > sizeof(buf) || (read && 2U + (reads + 1U) * 4U > sizeof(buf)))
+				break;
+			buf[len++] = transfer->request;
+			if (read) {
+				++reads;
+				continue;
+			}
+			buf[len++] = transfer->value & 0xffU;
+			buf[len++] = (transfer->value >> 8U) & 0xffU;
+			buf[len++] = (transfer->value >> 16U) & 0xffU;
+			buf[len++] = (transfer->value >> 24U) & 0xffU;
+		}
+		buf[2] = requests;
+		dbg_dap_cmd(buf, sizeof(buf), len);
+
+		/* The response holds the data of every read that completed, in order */
+		const size_t done = buf[0] < requests ? buf[0] : requests;
+		const uint8_t ack = buf[1];
+		const uint8_t *data = buf + 2;
+		for (size_t i = 0; i < done; ++i) {
+			const dap_transfer_s *const transfer = &transfers[index + i];
+			if (!(transfer->request & DAP_TRANSFER_RnW))
+				continue;
+			if (transfer->result)
+				*transfer->result = ((uint32_t)data[3] << 24U) | ((uint32_t)data[2] << 16U) |
+					((uint32_t)data[1] << 8U) | (uint32_t)data[0];
+			data += 4;
+		}
+		index += done;
+
+		if (ack == DAP_TRANSFER_OK && done == requests)
+			continue;
+		/* Resume from the request that saw WAIT */
+		if (ack == DAP_TRANSFER_WAIT)
+			continue;
+		if (ack == DAP_TRANSFER_FAULT) {
+			DEBUG_WARN("dap_queue_flush fault after %zu of %zu transfers\n", index, count);
+			dp->fault = 1;
+			return;
+		}
+		raise_exception(EXCEPTION_ERROR, "SWDP invalid ACK");
+	}
+}
+
+void dap_queue_flush(ADIv5_DP_t *dp, const adiv5_queued_access_s *const accesses, const size_t count)
+{
+	DEBUG_PROBE("dap_queue_flush %zu accesses\n", count);
+	adiv5_queued_access_s raw[ADIV5_QUEUE_DEPTH * 2U];
+	dap_transfer_s transfers[ADIV5_QUEUE_DEPTH * 2U];
+	const size_t transfer_count = adiv5_queue_expand(accesses, count, raw);
+	for (size_t i = 0; i < transfer_count; ++i) {
+		uint8_t request = raw[i].addr & 0x0cU;
+		if (raw[i].addr & ADIV5_APnDP)
+			request |= DAP_TRANSFER_APnDP;
+		if (raw[i].read)
+			request |= DAP_TRANSFER_RnW;
+		transfers[i] = (dap_transfer_s){request, raw[i].value, raw[i].result};
+	}
+	dap_transfer_run(dp, transfers, transfer_count);
+}
+
 void dap_read_single(ADIv5_AP_t *ap, void *dest, uint32_t src, enum align align)
 {
 	uint8_t buf[63];
@@ -78,6 +78,7 @@ unsigned int dap_write_block(ADIv5_AP_t *ap, uint32_t dest, const void *src, siz
 void dap_ap_mem_access_setup(ADIv5_AP_t *ap, uint32_t addr, enum align align);
 uint32_t dap_ap_read(ADIv5_AP_t *ap, uint16_t addr);
 void dap_ap_write(ADIv5_AP_t *ap, uint16_t addr, uint32_t value);
+void dap_queue_flush(ADIv5_DP_t *dp, const adiv5_queued_access_s *accesses, size_t count);
 void dap_read_single(ADIv5_AP_t *ap, void *dest, uint32_t src, enum align align);
 void dap_write_single(ADIv5_AP_t *ap, uint32_t dest, const void *src, enum align align);
 int dbg_dap_cmd(uint8_t *data, int size, int rsize);
@@ -0,0 +1,211 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This file implements a cache of what was last programmed into each Flash.
+ *
+ * For incremental loads, the CRC of each erase block is kept in a file keyed by
+ * the probe serial number, the target part ID and the Flash start address. The
+ * CRC of the whole Flash, computed on the target, is stored alongside. When it
+ * still matches at the next load nothing was changed behind our back, and
+ * blocks are compared against the cached CRCs without reading them back.
+ *
+ * The cache is only used for targets that can compute a CRC themselves, as
+ * reading back the whole Flash to validate it would defeat the purpose.
+ */
+
+#include "general.h"
+#include "target_internal.h"
+#include "crc32.h"
+#include "bmp_hosted.h"
+#include "flash_cache.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+
+#define FLASH_CACHE_MAGIC   0x43464d42U /* "BMFC" */
+#define FLASH_CACHE_VERSION 1U
+
+typedef struct flash_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t length;
+	uint32_t blocksize;
+	uint32_t flash_crc; /* CRC of the whole Flash when the cache was saved */
+} flash_cache_header_s;
+
+struct flash_cache {
+	flash_cache_header_s header;
+	size_t blocks;
+	uint8_t *known;       /* bitmap of the blocks whose CRC is known */
+	uint32_t block_crc[]; /* CRC of each block, followed by the known bitmap */
+};
+
+static bool flash_cache_mkdir(const char *path)
+{
+#if defined(_WIN32) || defined(__CYGWIN__)
+	const int result = mkdir(path);
+#else
+	const int result = mkdir(path, 0755);
+#endif
+	return !result || errno == EEXIST;
+}
+
+static bool flash_cache_path(const target_flash_s *f, char *path, size_t size)
+{
+	const char *base = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+#if defined(_WIN32) || defined(__CYGWIN__)
+	if (!base || !base[0])
+		base = getenv("LOCALAPPDATA");
+#endif
+	char dir[512];
+	if (base && base[0])
+		snprintf(dir, sizeof(dir), "%s", base);
+	else if (home && home[0]) {
+		snprintf(dir, sizeof(dir), "%s/.cache", home);
+		if (!flash_cache_mkdir(dir))
+			return false;
+	} else
+		return false;
+
+	const size_t len = strlen(dir);
+	snprintf(dir + len, sizeof(dir) - len, "/blackmagic");
+	if (!flash_cache_mkdir(dir))
+		return false;
+
+	const int written = snprintf(path, size, "%s/flash-%s-%04x-%08" PRIx32 ".cache", dir,
+		info.serial[0] ? info.serial : "unknown", f->t->part_id, f->start);
+	return written > 0 && (size_t)written < size;
+}
+
+static size_t flash_cache_known_size(const struct flash_cache *cache)
+{
+	return (cache->blocks + 7U) / 8U;
+}
+
+static bool flash_cache_flash_crc(target_flash_s *f, uint32_t *crc)
+{
+	target *t = f->t;
+	return t->mem_crc32 && t->mem_crc32(t, f->start, f->length, crc);
+}
+
+static size_t flash_cache_block(const target_flash_s *f, target_addr_t addr)
+{
+	return (addr - f->start) / f->blocksize;
+}
+
+static bool flash_cache_read(target_flash_s *f, struct flash_cache *cache)
+{
+	char path[640];
+	if (!flash_cache_path(f, path, sizeof(path)))
+		return false;
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	flash_cache_header_s header;
+	const bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == FLASH_CACHE_MAGIC &&
+		header.version == FLASH_CACHE_VERSION && header.length == f->length && header.blocksize == f->blocksize &&
+		fread(cache->block_crc, sizeof(uint32_t), cache->blocks, file) == cache->blocks &&
+		fread(cache->known, flash_cache_known_size(cache), 1, file) == 1;
+	fclose(file);
+	if (ok)
+		cache->header = header;
+	return ok;
+}
+
+void flash_cache_open(target_flash_s *f)
+{
+	uint32_t flash_crc;
+	if (f->cache || !flash_cache_flash_crc(f, &flash_crc))
+		return;
+
+	const size_t blocks = f->length / f->blocksize;
+	struct flash_cache *cache = calloc(1, sizeof(*cache) + blocks * sizeof(uint32_t) + (blocks + 7U) / 8U);
+	if (!cache) { /* calloc failed: heap exhaustion */
+		DEBUG_WARN("calloc: failed in %s\n", __func__);
+		return;
+	}
+	cache->blocks = blocks;
+	cache->known = (uint8_t *)(cache->block_crc + blocks);
+
+	bool valid = false;
+	if (flash_cache_read(f, cache)) {
+		valid = cache->header.flash_crc == flash_crc;
+		DEBUG_INFO("Flash cache for 0x%08" PRIx32 ": %s\n", f->start,
+			valid ? "valid" : "stale, the Flash was changed since");
+	}
+	/* Start afresh, recording what this session programs */
+	if (!valid)
+		memset(cache->known, 0, flash_cache_known_size(cache));
+	f->cache = cache;
+}
+
+bool flash_cache_lookup(target_flash_s *f, target_addr_t addr, const uint8_t *data, bool *matches)
+{
+	struct flash_cache *cache = f->cache;
+	if (!cache)
+		return false;
+	const size_t block = flash_cache_block(f, addr);
+	if (!(cache->known[block / 8U] & (1U << (block % 8U))))
+		return false;
+	*matches = cache->block_crc[block] == crc32_update(0xffffffffU, data, f->blocksize);
+	return true;
+}
+
+void flash_cache_update(target_flash_s *f, target_addr_t addr, const uint8_t *data)
+{
+	struct flash_cache *cache = f->cache;
+	if (!cache)
+		return;
+	const size_t block = flash_cache_block(f, addr);
+	cache->block_crc[block] = crc32_update(0xffffffffU, data, f->blocksize);
+	cache->known[block / 8U] |= 1U << (block % 8U);
+}
+
+void flash_cache_forget(target_flash_s *f, target_addr_t addr)
+{
+	struct flash_cache *cache = f->cache;
+	if (!cache)
+		return;
+	const size_t block = flash_cache_block(f, addr);
+	cache->known[block / 8U] &= ~(1U << (block % 8U));
+}
+
+void flash_cache_close(target_flash_s *f, bool success)
+{
+	struct flash_cache *cache = f->cache;
+	if (!cache)
+		return;
+	f->cache = NULL;
+
+	char path[640];
+	if (success && flash_cache_flash_crc(f, &cache->header.flash_crc) && flash_cache_path(f, path, sizeof(path))) {
+		cache->header.magic = FLASH_CACHE_MAGIC;
+		cache->header.version = FLASH_CACHE_VERSION;
+		cache->header.length = f->length;
+		cache->header.blocksize = f->blocksize;
+		FILE *file = fopen(path, "wb");
+		if (!file || fwrite(&cache->header, sizeof(cache->header), 1, file) != 1 ||
+			fwrite(cache->block_crc, sizeof(uint32_t), cache->blocks, file) != cache->blocks ||
+			fwrite(cache->known, flash_cache_known_size(cache), 1, file) != 1)
+			DEBUG_WARN("Flash cache: failed to write %s\n", path);
+		if (file)
+			fclose(file);
+	}
+	free(cache);
+}
@@ -0,0 +1,34 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLATFORMS_HOSTED_FLASH_CACHE_H
+#define PLATFORMS_HOSTED_FLASH_CACHE_H
+
+#include "target_internal.h"
+
+/* Load the cache for this Flash and check the Flash still holds what it describes */
+void flash_cache_open(target_flash_s *f);
+/* True if the cache knows whether the block at addr holds data, the answer in *matches */
+bool flash_cache_lookup(target_flash_s *f, target_addr_t addr, const uint8_t *data, bool *matches);
+/* Record the block at addr now holds data */
+void flash_cache_update(target_flash_s *f, target_addr_t addr, const uint8_t *data);
+/* Record the contents of the block at addr are no longer known */
+void flash_cache_forget(target_flash_s *f, target_addr_t addr);
+/* Save the cache if the Flash session succeeded, and release it */
+void flash_cache_close(target_flash_s *f, bool success);
+
+#endif /* PLATFORMS_HOSTED_FLASH_CACHE_H */
@@ -0,0 +1,184 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This file implements pipelined Flash writes for the hosted GDB server.
+ *
+ * vFlashWrite packets are acknowledged as soon as their data is queued and a
+ * worker thread programs them, so GDB sends the next packet while the probe
+ * programs the last one. A failed write is reported on the next vFlashWrite
+ * or at vFlashDone, and the writes queued behind it are dropped.
+ *
+ * Only the worker touches the target while writes are queued: the GDB server
+ * calls flash_pipeline_sync() before handling any other packet. The worker
+ * never talks to GDB, the server owns that link, so its console output is
+ * muted and the progress keepalives are sent from flash_pipeline_result()
+ * while vFlashDone waits. Exception handler chains are per thread.
+ */
+
+#include "general.h"
+#include "exception.h"
+#include "gdb_packet.h"
+#include "target_internal.h"
+#include "flash_pipeline.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#define FLASH_PIPELINE_DEPTH 8U
+
+typedef struct flash_pipeline_entry {
+	target *t;
+	target_addr_t dest;
+	uint8_t *data;
+	size_t len;
+} flash_pipeline_entry_s;
+
+static pthread_mutex_t pipeline_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pipeline_queued = PTHREAD_COND_INITIALIZER;     /* an entry was queued */
+static pthread_cond_t pipeline_programmed = PTHREAD_COND_INITIALIZER; /* an entry was taken off the queue */
+static flash_pipeline_entry_s pipeline_queue[FLASH_PIPELINE_DEPTH];
+static size_t pipeline_head;
+static size_t pipeline_count; /* queued entries, including the one being programmed */
+static bool pipeline_failed;
+static bool pipeline_enabled;
+static bool pipeline_started;
+static pthread_t pipeline_worker;
+
+static void *flash_pipeline_run(void *arg)
+{
+	(void)arg;
+	/* Erase waits report progress, which would interleave with the server's packets */
+	gdb_out_mute(true);
+	pthread_mutex_lock(&pipeline_lock);
+	while (true) {
+		while (!pipeline_count)
+			pthread_cond_wait(&pipeline_queued, &pipeline_lock);
+		const flash_pipeline_entry_s entry = pipeline_queue[pipeline_head];
+		const bool skip = pipeline_failed;
+		pthread_mutex_unlock(&pipeline_lock);
+
+		volatile bool ok = true;
+		if (!skip) {
+			volatile struct exception e;
+			TRY_CATCH (e, EXCEPTION_ALL) {
+				ok = target_flash_write(entry.t, entry.dest, entry.data, entry.len);
+			}
+			if (e.type) {
+				DEBUG_WARN("Flash write at 0x%08" PRIx32 ": %s\n", entry.dest, e.msg);
+				ok = false;
+			}
+		}
+		free(entry.data);
+
+		pthread_mutex_lock(&pipeline_lock);
+		if (!ok)
+			pipeline_failed = true;
+		pipeline_head = (pipeline_head + 1U) % FLASH_PIPELINE_DEPTH;
+		--pipeline_count;
+		pthread_cond_broadcast(&pipeline_programmed);
+	}
+	return NULL;
+}
+
+void flash_pipeline_enable(bool enable)
+{
+	pipeline_enabled = enable;
+}
+
+bool flash_pipeline_enabled(void)
+{
+	return pipeline_enabled;
+}
+
+/*
+ * Wait, with pipeline_lock held, for the worker to take an entry off the queue.
+ * The wait is bounded so GDB blocked on this packet keeps getting told we are busy,
+ * as it would be during a direct write.
+ */
+static void flash_pipeline_wait(platform_timeout *timeout)
+{
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += 100000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_nsec -= 1000000000L;
+		++deadline.tv_sec;
+	}
+	pthread_cond_timedwait(&pipeline_programmed, &pipeline_lock, &deadline);
+	pthread_mutex_unlock(&pipeline_lock);
+	target_print_progress(timeout);
+	pthread_mutex_lock(&pipeline_lock);
+}
+
+bool flash_pipeline_write(target *t, target_addr_t dest, const void *src, size_t len)
+{
+	if (!pipeline_started) {
+		if (pthread_create(&pipeline_worker, NULL, flash_pipeline_run, NULL)) {
+			DEBUG_WARN("Flash pipeline: worker failed to start, writing directly\n");
+			pipeline_enabled = false;
+			return target_flash_write(t, dest, src, len);
+		}
+		pipeline_started = true;
+	}
+
+	uint8_t *data = malloc(len);
+	if (!data) { /* malloc failed: heap exhaustion */
+		DEBUG_WARN("malloc: failed in %s\n", __func__);
+		return flash_pipeline_result() && target_flash_write(t, dest, src, len);
+	}
+	memcpy(data, src, len);
+
+	platform_timeout timeout;
+	platform_timeout_set(&timeout, 500);
+	pthread_mutex_lock(&pipeline_lock);
+	while (pipeline_count == FLASH_PIPELINE_DEPTH && !pipeline_failed)
+		flash_pipeline_wait(&timeout);
+	if (pipeline_failed) {
+		pthread_mutex_unlock(&pipeline_lock);
+		free(data);
+		return flash_pipeline_result();
+	}
+	const size_t tail = (pipeline_head + pipeline_count) % FLASH_PIPELINE_DEPTH;
+	pipeline_queue[tail] = (flash_pipeline_entry_s){t, dest, data, len};
+	++pipeline_count;
+	pthread_cond_signal(&pipeline_queued);
+	pthread_mutex_unlock(&pipeline_lock);
+	return true;
+}
+
+void flash_pipeline_sync(void)
+{
+	platform_timeout timeout;
+	platform_timeout_set(&timeout, 500);
+	pthread_mutex_lock(&pipeline_lock);
+	while (pipeline_count)
+		flash_pipeline_wait(&timeout);
+	pthread_mutex_unlock(&pipeline_lock);
+}
+
+bool flash_pipeline_result(void)
+{
+	platform_timeout timeout;
+	platform_timeout_set(&timeout, 500);
+	pthread_mutex_lock(&pipeline_lock);
+	while (pipeline_count)
+		flash_pipeline_wait(&timeout);
+	const bool failed = pipeline_failed;
+	pipeline_failed = false;
+	pthread_mutex_unlock(&pipeline_lock);
+	return !failed;
+}
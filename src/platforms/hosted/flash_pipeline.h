@@ -0,0 +1,32 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLATFORMS_HOSTED_FLASH_PIPELINE_H
+#define PLATFORMS_HOSTED_FLASH_PIPELINE_H
+
+#include "target.h"
+
+void flash_pipeline_enable(bool enable);
+bool flash_pipeline_enabled(void);
+/* Queue a Flash write, false if an earlier queued write failed */
+bool flash_pipeline_write(target *t, target_addr_t dest, const void *src, size_t len);
+/* Wait for all queued writes to be programmed, failures stay pending */
+void flash_pipeline_sync(void);
+/* Wait for all queued writes to be programmed, false if any failed */
+bool flash_pipeline_result(void);
+
+#endif /* PLATFORMS_HOSTED_FLASH_PIPELINE_H */
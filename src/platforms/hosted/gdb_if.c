@@ -42,8 +42,14 @@
 #include <unistd.h>
 
 #include "gdb_if.h"
+#include "gdb_packet.h"
 
 static int gdb_if_serv, gdb_if_conn;
+
+/* Receive buffer for the current connection, refilled with one recv() once drained */
+static uint8_t rx_buf[4096];
+static size_t rx_head = 0;
+static size_t rx_count = 0;
 #define DEFAULT_PORT 2000
 #define NUM_GDB_SERVER 4
 int gdb_if_init(void)
@@ -122,59 +128,33 @@ int gdb_if_init(void)
 }
 
 
-unsigned char gdb_if_getchar(void)
+/* Wait for data from GDB, accepting a new connection if needed. Returns false if the connection dropped */
+static bool gdb_if_fill(void)
 {
-	unsigned char ret;
 	int i = 0;
 #if defined(_WIN32) || defined(__CYGWIN__)
-	int iResult;
 	unsigned long opt;
 #else
 	int flags;
 #endif
 	while(i <= 0) {
 		if(gdb_if_conn <= 0) {
+			SET_IDLE_STATE(1);
+			/* Sleep in accept() until GDB connects */
+			gdb_if_conn = accept(gdb_if_serv, NULL, NULL);
+			if (gdb_if_conn == -1) {
 #if defined(_WIN32) || defined(__CYGWIN__)
-			opt = 1;
-			iResult = ioctlsocket(gdb_if_serv, FIONBIO, &opt);
-			if (iResult != NO_ERROR) {
-				DEBUG_WARN("ioctlsocket failed with error: %ld\n", iResult);
-			}
-#else
-			flags = fcntl(gdb_if_serv, F_GETFL);
-			fcntl(gdb_if_serv, F_SETFL, flags | O_NONBLOCK);
-#endif
-			while(1) {
-				gdb_if_conn = accept(gdb_if_serv, NULL, NULL);
-				if (gdb_if_conn == -1) {
-#if defined(_WIN32) || defined(__CYGWIN__)
-					if (WSAGetLastError() == WSAEWOULDBLOCK) {
-#else
-					if (errno == EWOULDBLOCK) {
-#endif
-						SET_IDLE_STATE(1);
-						platform_delay(100);
-					} else {
-#if defined(_WIN32) || defined(__CYGWIN__)
-						DEBUG_WARN("error when accepting connection: %d",
-								   WSAGetLastError());
-#else
-						DEBUG_WARN("error when accepting connection: %s",
-								   strerror(errno));
-#endif
-						exit(1);
-					}
-				} else {
-#if defined(_WIN32) || defined(__CYGWIN__)
-					opt = 0;
-					ioctlsocket(gdb_if_serv, FIONBIO, &opt);
+				DEBUG_WARN("error when accepting connection: %d",
+						   WSAGetLastError());
 #else
-					fcntl(gdb_if_serv, F_SETFL, flags);
+				DEBUG_WARN("error when accepting connection: %s",
+						   strerror(errno));
 #endif
-					break;
-				}
+				exit(1);
 			}
 			DEBUG_INFO("Got connection\n");
+			/* A new GDB always starts out with acknowledgements */
+			gdb_set_noackmode(false);
 #if defined(_WIN32) || defined(__CYGWIN__)
 			opt = 0;
 			ioctlsocket(gdb_if_conn, FIONBIO, &opt);
@@ -183,19 +163,71 @@ unsigned char gdb_if_getchar(void)
 			fcntl(gdb_if_conn, F_SETFL, flags & ~O_NONBLOCK);
 #endif
 		}
-		i = recv(gdb_if_conn, (void*)&ret, 1, 0);
+		i = recv(gdb_if_conn, (void*)rx_buf, sizeof(rx_buf), 0);
 		if(i <= 0) {
 			gdb_if_conn = -1;
+			rx_head = 0;
+			rx_count = 0;
 #if defined(_WIN32) || defined(__CYGWIN__)
 			DEBUG_INFO("Dropped broken connection: %d\n", WSAGetLastError());
 #else
 			DEBUG_INFO("Dropped broken connection: %s\n", strerror(errno));
 #endif
-			/* Return '+' in case we were waiting for an ACK */
-			return '+';
+			return false;
 		}
 	}
-	return ret;
+	rx_head = 0;
+	rx_count = i;
+	return true;
+}
+
+unsigned char gdb_if_getchar(void)
+{
+	/* Return '+' in case we were waiting for an ACK */
+	if (rx_head == rx_count && !gdb_if_fill())
+		return '+';
+	return rx_buf[rx_head++];
+}
+
+size_t gdb_if_read_block(char *const buf, const size_t len, const char delim, bool *const found)
+{
+	*found = false;
+	if (rx_head == rx_count && !gdb_if_fill())
+		return 0;
+
+	const uint8_t *const start = rx_buf + rx_head;
+	const uint8_t *const end = memchr(start, delim, rx_count - rx_head);
+	size_t count = end ? (size_t)(end - start) : rx_count - rx_head;
+	if (count > len)
+		count = len;
+	else if (end)
+		*found = true;
+	memcpy(buf, start, count);
+	rx_head += count + (*found ? 1U : 0U);
+	return count;
+}
+
+void gdb_if_wait(const uint32_t timeout)
+{
+	if (rx_head < rx_count)
+		return;
+	if (gdb_if_conn <= 0) {
+		platform_delay(timeout);
+		return;
+	}
+
+	fd_set fds;
+# if defined(__CYGWIN__)
+	TIMEVAL tv;
+#else
+	struct timeval tv;
+#endif
+	tv.tv_sec = timeout / 1000U;
+	tv.tv_usec = (timeout % 1000U) * 1000U;
+
+	FD_ZERO(&fds);
+	FD_SET(gdb_if_conn, &fds);
+	select(gdb_if_conn + 1, &fds, NULL, NULL, &tv);
 }
 
 unsigned char gdb_if_getchar_to(int timeout)
@@ -209,6 +241,9 @@ unsigned char gdb_if_getchar_to(int timeout)
 
 	if(gdb_if_conn == -1) return -1;
 
+	if (rx_head < rx_count)
+		return gdb_if_getchar();
+
 	tv.tv_sec = timeout / 1000;
 	tv.tv_usec = (timeout % 1000) * 1000;
 
@@ -221,19 +256,44 @@ unsigned char gdb_if_getchar_to(int timeout)
 	return -1;
 }
 
-void gdb_if_putchar(unsigned char c, int flush)
-{
 #if defined(__WIN32__) || defined(__CYGWIN__)
-	static char buf[2048];
+static char tx_buf[2048];
 #else
-	static uint8_t buf[2048];
+static uint8_t tx_buf[2048];
 #endif
-	static int bufsize = 0;
+static size_t tx_len = 0;
+
+static void gdb_if_flush(void)
+{
+	if (tx_len) {
+		send(gdb_if_conn, tx_buf, tx_len, 0);
+		tx_len = 0;
+	}
+}
+
+void gdb_if_putchar(unsigned char c, int flush)
+{
 	if (gdb_if_conn > 0) {
-		buf[bufsize++] = c;
-		if (flush || (bufsize == sizeof(buf))) {
-			send(gdb_if_conn, buf, bufsize, 0);
-			bufsize = 0;
+		tx_buf[tx_len++] = c;
+		if (flush || (tx_len == sizeof(tx_buf)))
+			gdb_if_flush();
+	}
+}
+
+void gdb_if_write(const void *const buf, const size_t len, const int flush)
+{
+	if (gdb_if_conn <= 0)
+		return;
+	if (tx_len + len > sizeof(tx_buf)) {
+		gdb_if_flush();
+		/* Blocks too large to buffer go straight to the socket */
+		if (len >= sizeof(tx_buf)) {
+			send(gdb_if_conn, buf, len, 0);
+			return;
 		}
 	}
+	memcpy(tx_buf + tx_len, buf, len);
+	tx_len += len;
+	if (flush || (tx_len == sizeof(tx_buf)))
+		gdb_if_flush();
 }
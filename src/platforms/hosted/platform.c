@@ -28,6 +28,8 @@
 #include "timing.h"
 #include "cli.h"
 #include "gdb_if.h"
+#include "gdb_main.h"
+#include "flash_pipeline.h"
 #include <signal.h>
 
 #ifdef ENABLE_RTT
@@ -126,6 +128,8 @@ void platform_init(int argc, char **argv)
 	if (cl_opts.opt_mode != BMP_MODE_DEBUG)
 		exit(cl_execute(&cl_opts));
 	else {
+		gdb_set_packet_size(cl_opts.opt_packet_size);
+		flash_pipeline_enable(cl_opts.opt_flash_pipeline);
 		gdb_if_init();
 
 #ifdef ENABLE_RTT
@@ -483,10 +487,14 @@ void platform_buffer_flush(void)
 	}
 }
 
+/* Interval between target halt polls while the target runs */
+#define HALT_POLL_INTERVAL_MS 8U
+
 void platform_pace_poll(void)
 {
+	/* Wake up early when GDB sends something so a Ctrl-C is acted on right away */
 	if (!cl_opts.fast_poll)
-		platform_delay(8);
+		gdb_if_wait(HALT_POLL_INTERVAL_MS);
 }
 
 void platform_target_clk_output_enable(const bool enable)
@@ -591,11 +599,13 @@ void adiv5_dp_write(ADIv5_DP_t *dp, uint16_t addr, uint32_t value)
 		ap_decode_access(addr, ADIV5_LOW_WRITE);
 		fprintf(stderr, " 0x%08" PRIx32 "\n", value);
 	}
+	adiv5_dp_shadow_clobber(dp, ADIV5_LOW_WRITE, addr, value);
 	dp->low_access(dp, ADIV5_LOW_WRITE, addr, value);
 }
 
 uint32_t adiv5_dp_read(ADIv5_DP_t *dp, uint16_t addr)
 {
+	adiv5_dp_shadow_clobber(dp, ADIV5_LOW_READ, addr, 0);
 	uint32_t ret = dp->dp_read(dp, addr);
 	if (cl_debuglevel & BMP_DEBUG_TARGET) {
 		ap_decode_access(addr, ADIV5_LOW_READ);
@@ -607,12 +617,16 @@ uint32_t adiv5_dp_read(ADIv5_DP_t *dp, uint16_t addr)
 uint32_t adiv5_dp_error(ADIv5_DP_t *dp)
 {
 	uint32_t ret = dp->error(dp);
+	/* Faulted accesses leave SELECT, CSW and TAR in an unknown state */
+	if (ret)
+		dp->shadow_valid = 0;
 	DEBUG_TARGET("DP Error 0x%08" PRIx32 "\n", ret);
 	return ret;
 }
 
 uint32_t adiv5_dp_low_access(struct ADIv5_DP_s *dp, uint8_t RnW, uint16_t addr, uint32_t value)
 {
+	adiv5_dp_shadow_clobber(dp, RnW, addr, value);
 	uint32_t ret = dp->low_access(dp, RnW, addr, value);
 	if (cl_debuglevel & BMP_DEBUG_TARGET) {
 		ap_decode_access(addr, RnW);
@@ -686,5 +700,6 @@ void adiv5_mem_write_sized(ADIv5_AP_t *ap, uint32_t dest, const void *src, size_
 void adiv5_dp_abort(struct ADIv5_DP_s *dp, uint32_t abort)
 {
 	DEBUG_TARGET("Abort: %08" PRIx32 "\n", abort);
+	dp->shadow_valid = 0;
 	return dp->abort(dp, abort);
 }
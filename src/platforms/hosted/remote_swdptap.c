@@ -29,11 +29,16 @@
 #include "general.h"
 #include "remote.h"
 #include "bmp_remote.h"
+#include "exception.h"
+#include "hex_utils.h"
 
 static bool swdptap_seq_in_parity(uint32_t *res, size_t clock_cycles);
 static uint32_t swdptap_seq_in(size_t clock_cycles);
 static void swdptap_seq_out(uint32_t tms_states, size_t clock_cycles);
 static void swdptap_seq_out_parity(uint32_t tms_states, size_t clock_cycles);
+static uint32_t remote_swdp_low_access(ADIv5_DP_t *dp, uint8_t RnW, uint16_t addr, uint32_t value);
+static uint32_t remote_swdp_read(ADIv5_DP_t *dp, uint16_t addr);
+static void remote_swdp_queue_flush(ADIv5_DP_t *dp, const adiv5_queued_access_s *accesses, size_t count);
 
 int remote_swdptap_init(ADIv5_DP_t *dp)
 {
@@ -56,9 +61,112 @@ int remote_swdptap_init(ADIv5_DP_t *dp)
 	dp->error = firmware_swdp_error;
 	dp->low_access = firmware_swdp_low_access;
 	dp->abort = firmware_swdp_abort;
+	/* Older firmware answers 0 and only knows the raw sequence packets */
+	const uint32_t version = remotehston(-1, (char *)&construct[1]);
+	DEBUG_INFO("Remote SWD protocol version %" PRIu32 "\n", version);
+	if (version >= REMOTE_SWDP_VERSION) {
+		dp->dp_read = remote_swdp_read;
+		dp->low_access = remote_swdp_low_access;
+		dp->queue_flush = remote_swdp_queue_flush;
+	}
 	return 0;
 }
 
+/* Check the reply to an SL or SB packet, returns false if the target faulted */
+static bool remote_swdp_response(ADIv5_DP_t *dp, const uint8_t *construct, int s, const char *what)
+{
+	if (s >= 1 && construct[0] == REMOTE_RESP_OK)
+		return true;
+	if (s >= 2 && construct[0] == REMOTE_RESP_ERR) {
+		const uint32_t err = remotehston(-1, (const char *)&construct[1]);
+		if ((err & 0xffU) == REMOTE_ERROR_FAULT) {
+			DEBUG_WARN("%s fault at transaction %" PRIu32 "\n", what, err >> 8U);
+			dp->fault = 1;
+			return false;
+		}
+		if ((err & 0xffU) == REMOTE_ERROR_EXCEPTION)
+			raise_exception(err >> 8U, "Remote SWD transaction failed");
+	}
+	DEBUG_WARN("%s failed, error %s\n", what, s ? (char *)construct + 1 : "short response");
+	exit(-1);
+}
+
+static uint32_t remote_swdp_low_access(ADIv5_DP_t *dp, uint8_t RnW, uint16_t addr, uint32_t value)
+{
+	if ((addr & ADIV5_APnDP) && dp->fault)
+		return 0;
+
+	uint8_t construct[REMOTE_MAX_MSG_SIZE];
+	int s = sprintf((char *)construct, REMOTE_SWDP_LOW_ACCESS_STR, RnW, addr, value);
+	platform_buffer_write(construct, s);
+
+	s = platform_buffer_read(construct, REMOTE_MAX_MSG_SIZE);
+	if (!remote_swdp_response(dp, construct, s, "remote_swdp_low_access"))
+		return 0;
+	const uint32_t res = remotehston(-1, (char *)&construct[1]);
+	DEBUG_PROBE("remote_swdp_low_access %s %04x %08" PRIx32 "\n", RnW ? "R" : "W", addr, RnW ? res : value);
+	return res;
+}
+
+/*
+ * Send up to REMOTE_SWDP_BATCH_MAX raw accesses as one SB packet. Reads are
+ * full adiv5_dp_read()s on the probe, so AP reads need no RDBUFF from here.
+ */
+static void remote_swdp_batch(ADIv5_DP_t *dp, const adiv5_queued_access_s *accesses, size_t count)
+{
+	uint8_t construct[REMOTE_MAX_MSG_SIZE];
+	int s = sprintf((char *)construct, REMOTE_SWDP_BATCH_STR, (unsigned)count);
+	for (size_t i = 0; i < count; ++i) {
+		const adiv5_queued_access_s *const access = &accesses[i];
+		if (access->read)
+			s += sprintf((char *)construct + s, "%02x%04x", ADIV5_LOW_READ, access->addr);
+		else
+			s += sprintf((char *)construct + s, "%02x%04x%08" PRIx32, ADIV5_LOW_WRITE, access->addr, access->value);
+	}
+	construct[s++] = REMOTE_EOM;
+	platform_buffer_write(construct, s);
+
+	s = platform_buffer_read(construct, REMOTE_MAX_MSG_SIZE);
+	if (!remote_swdp_response(dp, construct, s, "remote_swdp_batch"))
+		return;
+
+	/* The reply holds each read value as 4 little endian bytes, in order */
+	const char *data = (const char *)&construct[1];
+	for (size_t i = 0; i < count; ++i) {
+		const adiv5_queued_access_s *const access = &accesses[i];
+		if (!access->read)
+			continue;
+		uint8_t value[4];
+		unhexify(value, data, sizeof(value));
+		data += 8;
+		if (access->result)
+			*access->result = ((uint32_t)value[3] << 24U) | ((uint32_t)value[2] << 16U) |
+				((uint32_t)value[1] << 8U) | (uint32_t)value[0];
+	}
+}
+
+static void remote_swdp_queue_flush(ADIv5_DP_t *dp, const adiv5_queued_access_s *accesses, size_t count)
+{
+	DEBUG_PROBE("remote_swdp_queue_flush %zu accesses\n", count);
+	adiv5_queued_access_s raw[ADIV5_QUEUE_DEPTH * 2U];
+	const size_t raw_count = adiv5_queue_expand(accesses, count, raw);
+	for (size_t i = 0; i < raw_count && !dp->fault; i += REMOTE_SWDP_BATCH_MAX) {
+		const size_t chunk = raw_count - i < REMOTE_SWDP_BATCH_MAX ? raw_count - i : REMOTE_SWDP_BATCH_MAX;
+		remote_swdp_batch(dp, raw + i, chunk);
+	}
+}
+
+static uint32_t remote_swdp_read(ADIv5_DP_t *dp, uint16_t addr)
+{
+	if ((addr & ADIV5_APnDP) && dp->fault)
+		return 0;
+	uint32_t res = 0;
+	const adiv5_queued_access_s access = {NULL, addr, true, 0, &res};
+	remote_swdp_batch(dp, &access, 1);
+	DEBUG_PROBE("remote_swdp_read %04x %08" PRIx32 "\n", addr, res);
+	return res;
+}
+
 static bool swdptap_seq_in_parity(uint32_t *res, size_t clock_cycles)
 {
 	uint8_t construct[REMOTE_MAX_MSG_SIZE];
@@ -244,3 +244,58 @@ int platform_buffer_read(uint8_t *data, int maxsize)
 	return(-6);
 	return 0;
 }
+
+/* Read exactly size bytes, sharing the timeout in tv across calls */
+static int serial_read_exact(uint8_t *data, size_t size, struct timeval *tv)
+{
+	size_t offset = 0;
+	while (offset < size) {
+		fd_set rset;
+		FD_ZERO(&rset);
+		FD_SET(fd, &rset);
+		const int ret = select(fd + 1, &rset, NULL, NULL, tv);
+		if (ret < 0) {
+			DEBUG_WARN("Failed on select\n");
+			return -3;
+		}
+		if (ret == 0) {
+			DEBUG_WARN("Timeout on read\n");
+			return -4;
+		}
+		const ssize_t s = read(fd, data + offset, size - offset);
+		if (s < 0) {
+			DEBUG_WARN("Failed to read\n");
+			return -6;
+		}
+		offset += s;
+	}
+	return offset;
+}
+
+int platform_buffer_read_binary(uint8_t *data, int size, uint8_t *tag)
+{
+	struct timeval tv;
+	tv.tv_sec = cortexm_wait_timeout / 1000;
+	tv.tv_usec = 1000 * (cortexm_wait_timeout % 1000);
+
+	/* Look for start of response */
+	uint8_t c = 0;
+	do {
+		if (serial_read_exact(&c, 1, &tv) < 0)
+			return -4;
+	} while (c != REMOTE_RESP);
+	uint8_t code = 0;
+	char hex[3] = {0};
+	if (serial_read_exact(&code, 1, &tv) < 0 || serial_read_exact((uint8_t *)hex, 2, &tv) < 0)
+		return -5;
+	*tag = remotehston(2, hex);
+	if (code == REMOTE_RESP_OK && serial_read_exact(data, size, &tv) < 0)
+		return -5;
+	/* Anything else up to the EOM is the parameter of an error response */
+	do {
+		if (serial_read_exact(&c, 1, &tv) < 0)
+			return -5;
+	} while (c != REMOTE_EOM);
+	DEBUG_WIRE("       %c%s + %d bytes\n", code, hex, code == REMOTE_RESP_OK ? size : 0);
+	return code;
+}
@@ -176,3 +176,48 @@ int platform_buffer_read(uint8_t *data, int maxsize)
 	exit(-3);
 	return 0;
 }
+
+/* Read exactly size bytes before end_time */
+static bool serial_read_exact(uint8_t *data, size_t size, uint32_t end_time)
+{
+	size_t offset = 0;
+	while (offset < size) {
+		DWORD s;
+		if (!ReadFile(hComm, data + offset, size - offset, &s, NULL)) {
+			DEBUG_WARN("Error on read\n");
+			return false;
+		}
+		offset += s;
+		if (offset < size && platform_time_ms() > end_time) {
+			DEBUG_WARN("Timeout on read\n");
+			return false;
+		}
+	}
+	return true;
+}
+
+int platform_buffer_read_binary(uint8_t *data, int size, uint8_t *tag)
+{
+	const uint32_t end_time = platform_time_ms() + cortexm_wait_timeout;
+
+	/* Look for start of response */
+	uint8_t c = 0;
+	do {
+		if (!serial_read_exact(&c, 1, end_time))
+			return -4;
+	} while (c != REMOTE_RESP);
+	uint8_t code = 0;
+	char hex[3] = {0};
+	if (!serial_read_exact(&code, 1, end_time) || !serial_read_exact((uint8_t *)hex, 2, end_time))
+		return -5;
+	*tag = remotehston(2, hex);
+	if (code == REMOTE_RESP_OK && !serial_read_exact(data, size, end_time))
+		return -5;
+	/* Anything else up to the EOM is the parameter of an error response */
+	do {
+		if (!serial_read_exact(&c, 1, end_time))
+			return -5;
+	} while (c != REMOTE_EOM);
+	DEBUG_WIRE("       %c%s + %d bytes\n", code, hex, code == REMOTE_RESP_OK ? size : 0);
+	return code;
+}
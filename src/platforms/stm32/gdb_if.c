@@ -39,32 +39,51 @@ static volatile uint32_t count_new;
 static uint8_t double_buffer_out[CDCACM_PACKET_SIZE];
 #endif
 
-void gdb_if_putchar(unsigned char c, int flush)
+static void gdb_if_send(const bool flush)
 {
-	buffer_in[count_in++] = c;
-	if (flush || (count_in == CDCACM_PACKET_SIZE)) {
-		/* Refuse to send if USB isn't configured, and
-		 * don't bother if nobody's listening */
-		if (usb_get_config() != 1 || !gdb_serial_get_dtr()) {
-			count_in = 0;
-			return;
-		}
-		while (usbd_ep_write_packet(usbdev, CDCACM_GDB_ENDPOINT, buffer_in, count_in) <= 0)
+	/* Refuse to send if USB isn't configured, and
+	 * don't bother if nobody's listening */
+	if (usb_get_config() != 1 || !gdb_serial_get_dtr()) {
+		count_in = 0;
+		return;
+	}
+	while (usbd_ep_write_packet(usbdev, CDCACM_GDB_ENDPOINT, buffer_in, count_in) <= 0)
+		continue;
+
+	if (flush && (count_in == CDCACM_PACKET_SIZE)) {
+		/* We need to send an empty packet for some hosts
+		 * to accept this as a complete transfer. */
+		/* libopencm3 needs a change for us to confirm when
+		 * that transfer is complete, so we just send a packet
+		 * containing a null byte for now.
+		 */
+		while (usbd_ep_write_packet(usbdev, CDCACM_GDB_ENDPOINT, "\0", 1) <= 0)
 			continue;
+	}
 
-		if (flush && (count_in == CDCACM_PACKET_SIZE)) {
-			/* We need to send an empty packet for some hosts
-			 * to accept this as a complete transfer. */
-			/* libopencm3 needs a change for us to confirm when
-			 * that transfer is complete, so we just send a packet
-			 * containing a null byte for now.
-			 */
-			while (usbd_ep_write_packet(usbdev, CDCACM_GDB_ENDPOINT, "\0", 1) <= 0)
-				continue;
-		}
+	count_in = 0;
+}
 
-		count_in = 0;
+void gdb_if_putchar(unsigned char c, int flush)
+{
+	buffer_in[count_in++] = c;
+	if (flush || (count_in == CDCACM_PACKET_SIZE))
+		gdb_if_send(flush);
+}
+
+void gdb_if_write(const void *const buf, const size_t len, const int flush)
+{
+	const uint8_t *const data = (const uint8_t *)buf;
+	for (size_t offset = 0; offset < len;) {
+		const size_t amount = MIN(len - offset, CDCACM_PACKET_SIZE - count_in);
+		memcpy(buffer_in + count_in, data + offset, amount);
+		count_in += amount;
+		offset += amount;
+		if (count_in == CDCACM_PACKET_SIZE)
+			gdb_if_send(flush && offset == len);
 	}
+	if (flush && count_in)
+		gdb_if_send(true);
 }
 
 #ifdef STM32F4
@@ -34,20 +34,36 @@ static volatile uint32_t count_in;
 static volatile uint8_t buffer_out[16*CDCACM_PACKET_SIZE];
 static volatile uint8_t buffer_in[CDCACM_PACKET_SIZE];
 
+static void gdb_if_send(void)
+{
+	/* Refuse to send if USB isn't configured, and
+	 * don't bother if nobody's listening */
+	if (usb_get_config() != 1 || !gdb_serial_get_dtr()) {
+		count_in = 0;
+		return;
+	}
+	while (usbd_ep_write_packet(usbdev, CDCACM_GDB_ENDPOINT, (uint8_t *)buffer_in, count_in) <= 0)
+		continue;
+	count_in = 0;
+}
+
 void gdb_if_putchar(unsigned char c, int flush)
 {
 	buffer_in[count_in++] = c;
-	if (flush || count_in == CDCACM_PACKET_SIZE) {
-		/* Refuse to send if USB isn't configured, and
-		 * don't bother if nobody's listening */
-		if (usb_get_config() != 1 || !gdb_serial_get_dtr()) {
-			count_in = 0;
-			return;
-		}
-		while (usbd_ep_write_packet(usbdev, CDCACM_GDB_ENDPOINT, (uint8_t *)buffer_in, count_in) <= 0)
-			continue;
-		count_in = 0;
+	if (flush || count_in == CDCACM_PACKET_SIZE)
+		gdb_if_send();
+}
+
+void gdb_if_write(const void *const buf, const size_t len, const int flush)
+{
+	const uint8_t *const data = (const uint8_t *)buf;
+	for (size_t offset = 0; offset < len; ++offset) {
+		buffer_in[count_in++] = data[offset];
+		if (count_in == CDCACM_PACKET_SIZE)
+			gdb_if_send();
 	}
+	if (flush && count_in)
+		gdb_if_send();
 }
 
 void gdb_usb_out_cb(usbd_device *dev, uint8_t ep)
@@ -53,14 +53,13 @@ uint64_t remotehston(const uint32_t max, const char *const str)
 static void remote_send_buf(uint8_t *buffer, size_t len)
 {
 	uint8_t *p = buffer;
-	char hex[2];
-	do {
+	char hex[3]; /* hexify() terminates its output */
+	while (p < (buffer + len)) {
 		hexify(hex, (const void *)p++, 1);
 
 		gdb_if_putchar(hex[0], 0);
 		gdb_if_putchar(hex[1], 0);
-
-	} while (p < (buffer + len));
+	}
 }
 
 static void remote_respond_buf(char respCode, uint8_t *buffer, size_t len)
@@ -73,6 +72,30 @@ static void remote_respond_buf(char respCode, uint8_t *buffer, size_t len)
 	gdb_if_putchar(REMOTE_EOM, 1);
 }
 
+/* Answer a binary packet with its sequence tag, followed by len raw bytes the far end expects */
+static void remote_respond_tagged(char respCode, uint8_t tag, const void *buffer, size_t len)
+{
+	char hex[3]; /* hexify() terminates its output */
+	hexify(hex, &tag, 1);
+	gdb_if_putchar(REMOTE_RESP, 0);
+	gdb_if_putchar(respCode, 0);
+	gdb_if_putchar(hex[0], 0);
+	gdb_if_putchar(hex[1], 0);
+	gdb_if_write(buffer, len, 0);
+	gdb_if_putchar(REMOTE_EOM, 1);
+}
+
+/* Collect the len raw bytes following a binary packet, false if they do not fit */
+static bool remote_read_binary(uint8_t *buffer, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		const uint8_t c = gdb_if_getchar();
+		if (i < REMOTE_BINARY_MAX)
+			buffer[i] = c;
+	}
+	return len <= REMOTE_BINARY_MAX;
+}
+
 /* Send response to far end */
 static void remote_respond(char respCode, uint64_t param)
 {
@@ -117,11 +140,69 @@ static ADIv5_DP_t remote_dp = {
 	.mem_write_sized = firmware_mem_write_sized,
 };
 
+/* Walk the accesses of an SB packet to find how long it should be */
+static size_t remote_swd_batch_length(const char *packet, const size_t count, const size_t limit)
+{
+	size_t length = 0;
+	for (size_t index = 0; index < count && length + 6U <= limit; ++index) {
+		const uint8_t RnW = remotehston(2, packet + length);
+		length += RnW == ADIV5_LOW_WRITE ? 14U : 6U;
+	}
+	return length;
+}
+
+/*
+ * Run the SWD accesses of an SL or SB packet. Faults and exceptions are
+ * reported to the host, which owns the fault state, so nothing sticks here.
+ */
+static void remote_swd_transactions(char *packet, const size_t count, const bool batch)
+{
+	uint32_t data[REMOTE_SWDP_BATCH_MAX];
+	volatile size_t reads = 0;
+	volatile size_t index = 0;
+	volatile struct exception e;
+	TRY_CATCH (e, EXCEPTION_ALL) {
+		for (; index < count; ++index) {
+			const uint8_t RnW = remotehston(2, packet);
+			const uint16_t addr = remotehston(4, packet + 2);
+			packet += 6;
+			uint32_t value = 0;
+			if (!batch || RnW == ADIV5_LOW_WRITE) {
+				value = remotehston(8, packet);
+				packet += 8;
+			}
+			if (!batch)
+				data[reads++] = adiv5_dp_low_access(&remote_dp, RnW, addr, value);
+			else if (RnW == ADIV5_LOW_READ)
+				data[reads++] = adiv5_dp_read(&remote_dp, addr);
+			else
+				adiv5_dp_write(&remote_dp, addr, value);
+			if (remote_dp.fault)
+				break;
+		}
+	}
+	const bool fault = remote_dp.fault;
+	remote_dp.fault = 0;
+	if (e.type) {
+		remote_respond(REMOTE_RESP_ERR, REMOTE_ERROR_EXCEPTION | (e.type << 8U));
+		return;
+	}
+	if (fault) {
+		remote_respond(REMOTE_RESP_ERR, REMOTE_ERROR_FAULT | (index << 8U));
+		return;
+	}
+	if (!batch)
+		remote_respond(REMOTE_RESP_OK, data[0]);
+	else
+		remote_respond_buf(REMOTE_RESP_OK, (uint8_t *)data, reads * 4U);
+}
+
 static void remote_packet_process_swd(unsigned i, char *packet)
 {
 	uint8_t ticks;
 	uint32_t param;
 	bool badParity;
+	size_t count;
 
 	switch (packet[1]) {
 	case REMOTE_INIT: /* SS = initialise =============================== */
@@ -129,26 +210,32 @@ static void remote_packet_process_swd(unsigned i, char *packet)
 			remote_dp.dp_read = firmware_swdp_read;
 			remote_dp.low_access = firmware_swdp_low_access;
 			remote_dp.abort = firmware_swdp_abort;
+			remote_dp.error = firmware_swdp_error;
+			remote_dp.shadow_valid = 0;
 			swdptap_init(&remote_dp);
-			remote_respond(REMOTE_RESP_OK, 0);
+			remote_respond(REMOTE_RESP_OK, REMOTE_SWDP_VERSION);
 		} else {
 			remote_respond(REMOTE_RESP_ERR, REMOTE_ERROR_WRONGLEN);
 		}
 		break;
 
 	case REMOTE_IN_PAR: /* SI = In parity ============================= */
+		/* Raw sequences bypass the register shadows */
+		remote_dp.shadow_valid = 0;
 		ticks = remotehston(2, &packet[2]);
 		badParity = remote_dp.seq_in_parity(&param, ticks);
 		remote_respond(badParity ? REMOTE_RESP_PARERR : REMOTE_RESP_OK, param);
 		break;
 
 	case REMOTE_IN: /* Si = In ======================================= */
+		remote_dp.shadow_valid = 0;
 		ticks = remotehston(2, &packet[2]);
 		param = remote_dp.seq_in(ticks);
 		remote_respond(REMOTE_RESP_OK, param);
 		break;
 
 	case REMOTE_OUT: /* So= Out ====================================== */
+		remote_dp.shadow_valid = 0;
 		ticks = remotehston(2, &packet[2]);
 		param = remotehston(-1, &packet[4]);
 		remote_dp.seq_out(param, ticks);
@@ -156,12 +243,30 @@ static void remote_packet_process_swd(unsigned i, char *packet)
 		break;
 
 	case REMOTE_OUT_PAR: /* SO = Out parity ========================== */
+		remote_dp.shadow_valid = 0;
 		ticks = remotehston(2, &packet[2]);
 		param = remotehston(-1, &packet[4]);
 		remote_dp.seq_out_parity(param, ticks);
 		remote_respond(REMOTE_RESP_OK, 0);
 		break;
 
+	case REMOTE_LOW_ACCESS: /* SL = complete SWD transaction ========== */
+		if (i != 16) {
+			remote_respond(REMOTE_RESP_ERR, REMOTE_ERROR_WRONGLEN);
+			break;
+		}
+		remote_swd_transactions(&packet[2], 1, false);
+		break;
+
+	case REMOTE_BATCH: /* SB = batch of SWD transactions ============= */
+		count = remotehston(2, &packet[2]);
+		if (i < 4 || count > REMOTE_SWDP_BATCH_MAX || i != remote_swd_batch_length(&packet[4], count, i - 4U) + 4U) {
+			remote_respond(REMOTE_RESP_ERR, REMOTE_ERROR_WRONGLEN);
+			break;
+		}
+		remote_swd_transactions(&packet[4], count, true);
+		break;
+
 	default:
 		remote_respond(REMOTE_RESP_ERR, REMOTE_ERROR_UNRECOGNISED);
 		break;
@@ -175,6 +280,8 @@ static void remote_packet_process_jtag(unsigned i, char *packet)
 	size_t ticks;
 	uint64_t DI = 0;
 	jtag_dev_t jtag_dev;
+	/* Every JTAG packet drives the chain behind the register shadows' back */
+	remote_dp.shadow_valid = 0;
 	switch (packet[1]) {
 	case REMOTE_INIT: /* JS = initialise ============================= */
 		remote_dp.dp_read = fw_adiv5_jtagdp_read;
@@ -269,6 +376,8 @@ static void remotePacketProcessGEN(unsigned i, char *packet)
 
     case REMOTE_NRST_SET:
 		platform_nrst_set_val(packet[2] == '1');
+		/* As cortexm_reset(), do not trust the shadows across a reset */
+		remote_dp.shadow_valid = 0;
 		remote_respond(REMOTE_RESP_OK, 0);
 		break;
 
@@ -339,11 +448,17 @@ static void remotePacketProcessHL(unsigned i, char *packet)
 	void *src = (void *)(((uint32_t)packet + 7) & ~7);
 	char index = packet[1];
 	if (index == REMOTE_HL_CHECK) {
+		/* Sent as the host sets up a DP, which may be a fresh target */
+		remote_dp.shadow_valid = 0;
 		remote_respond(REMOTE_RESP_OK, REMOTE_HL_VERSION);
 		return;
 	}
 	packet += 2;
-	remote_dp.dp_jd_index = remotehston(2, packet);
+	const uint8_t dp_jd_index = remotehston(2, packet);
+	/* The shadows belong to the DP they were recorded on */
+	if (dp_jd_index != remote_dp.dp_jd_index)
+		remote_dp.shadow_valid = 0;
+	remote_dp.dp_jd_index = dp_jd_index;
 	packet += 2;
 	remote_ap.apsel = remotehston(2, packet);
 	remote_ap.dp = &remote_dp;
@@ -359,7 +474,7 @@ static void remotePacketProcessHL(unsigned i, char *packet)
 		addr16 = remotehston(4, packet);
 		packet += 4;
 		uint32_t value = remotehston(8, packet);
-		data = remote_dp.low_access(&remote_dp, remote_ap.apsel, addr16, value);
+		data = adiv5_dp_low_access(&remote_dp, remote_ap.apsel, addr16, value);
 		remote_respond_buf(REMOTE_RESP_OK, (uint8_t*)&data, 4);
 		break;
 	case REMOTE_AP_READ: /* Ha = Read from AP register*/
@@ -395,6 +510,27 @@ static void remotePacketProcessHL(unsigned i, char *packet)
 		remote_respond(REMOTE_RESP_ERR, 0);
 		remote_ap.dp->fault = 0;
 		break;
+	case REMOTE_AP_MEM_READ_BIN: /* Hr = Read from Mem and set csw, answer in binary */
+		packet += 2;
+		remote_ap.csw = remotehston(8, packet);
+		packet += 8;
+		address = remotehston(8, packet);
+		packet += 8;
+		count = remotehston(8, packet);
+		packet += 8;
+		uint8_t tag = remotehston(2, packet);
+		if (count > REMOTE_BINARY_MAX) {
+			remote_respond_tagged(REMOTE_RESP_ERR, tag, NULL, 0);
+			break;
+		}
+		adiv5_mem_read(&remote_ap, src, address, count);
+		if (remote_ap.dp->fault) {
+			remote_respond_tagged(REMOTE_RESP_ERR, tag, NULL, 0);
+			remote_ap.dp->fault = 0;
+			break;
+		}
+		remote_respond_tagged(REMOTE_RESP_OK, tag, src, count);
+		break;
 	case REMOTE_AP_MEM_WRITE_SIZED: /* Hm = Write to memory and set csw */
 		packet += 2;
 		remote_ap.csw = remotehston(8, packet);
@@ -424,6 +560,30 @@ static void remotePacketProcessHL(unsigned i, char *packet)
 		}
 		remote_respond(REMOTE_RESP_OK, 0);
 		break;
+	case REMOTE_AP_MEM_WRITE_BIN: /* Hw = Write to memory and set csw, data follows in binary */
+		packet += 2;
+		remote_ap.csw = remotehston(8, packet);
+		packet += 8;
+		align = remotehston(2, packet);
+		packet += 2;
+		dest = remotehston(8, packet);
+		packet += 8;
+		len = remotehston(8, packet);
+		packet += 8;
+		tag = remotehston(2, packet);
+		/* The data follows the packet, take it all even if it is not used */
+		if (!remote_read_binary(src, len) || (len & ((1 << align) - 1))) {
+			remote_respond_tagged(REMOTE_RESP_ERR, tag, NULL, 0);
+			break;
+		}
+		adiv5_mem_write_sized(&remote_ap, dest, src, len, align);
+		if (remote_ap.dp->fault) {
+			remote_respond_tagged(REMOTE_RESP_ERR, tag, NULL, 0);
+			remote_ap.dp->fault = 0;
+			break;
+		}
+		remote_respond_tagged(REMOTE_RESP_OK, tag, NULL, 0);
+		break;
 	default:
 		remote_respond(REMOTE_RESP_ERR,REMOTE_ERROR_UNRECOGNISED);
 		break;
@@ -24,7 +24,11 @@
 #include <inttypes.h>
 #include "general.h"
 
-#define REMOTE_HL_VERSION 2
+#define REMOTE_HL_VERSION 3
+/* Oldest firmware the hosted side uses the high level protocol with */
+#define REMOTE_HL_VERSION_MIN 2
+/* First version with binary memory transfers */
+#define REMOTE_HL_VERSION_BINARY 3
 
 /*
  * Commands to remote end, and responses
@@ -52,9 +56,58 @@
  * definition when anything is changed.
  */
 
+/*
+ * Binary memory transfers, available when HC answers with a version of
+ * REMOTE_HL_VERSION_BINARY or later:
+ *
+ *  Hr - read from memory and set csw
+ *         jj ap cccccccc aaaaaaaa llllllll - as HM, then tt - sequence tag
+ *       resp: Ktt followed by exactly llllllll raw bytes, then #
+ *             Ett      - failed
+ *
+ *  Hw - write to memory and set csw
+ *         jj ap cccccccc zz aaaaaaaa llllllll - as Hm, then tt, then #
+ *         followed by exactly llllllll raw bytes
+ *       resp: Ktt / Ett
+ *
+ * The length is given in the hex header, so the raw bytes need no escaping.
+ * Neither may exceed REMOTE_BINARY_MAX, the space left in the probe's packet
+ * buffer.
+ *
+ * Packets are run strictly in order, so the host may send up to
+ * REMOTE_MAX_OUTSTANDING of them before collecting the answers. Each answer
+ * echoes the tag of its packet, which lets the host check it stayed in step.
+ * The bound keeps the answers in flight within what the host's serial driver
+ * buffers, so the probe never stalls sending while the host is still sending.
+ */
+#define REMOTE_BINARY_MAX      1008U
+#define REMOTE_MAX_OUTSTANDING 4U
+
 /* Protocol error messages */
 #define REMOTE_ERROR_UNRECOGNISED 1
 #define REMOTE_ERROR_WRONGLEN     2
+/* Target answered FAULT, bits 15:8 hold the index of the failing transaction */
+#define REMOTE_ERROR_FAULT 3
+/* Exception raised on the probe, bits 15:8 hold its type */
+#define REMOTE_ERROR_EXCEPTION 4
+
+/*
+ * Composite SWD transactions, available when SS answers with a version of
+ * REMOTE_SWDP_VERSION or later:
+ *
+ *  SL - one complete low level access, as firmware_swdp_low_access()
+ *         rr - RnW, aaaa - address, vvvvvvvv - value
+ *       resp: K<PARAM> - value read
+ *             E<err>   - REMOTE_ERROR_FAULT or REMOTE_ERROR_EXCEPTION
+ *
+ *  SB - up to REMOTE_SWDP_BATCH_MAX accesses in one packet
+ *         nn - count, then per access rr aaaa and for writes vvvvvvvv
+ *         Reads behave as adiv5_dp_read(), so AP reads return their own data.
+ *       resp: K<DATA> - hexified 32 bit little endian values of all reads
+ *             E<err>   - as for SL, later accesses are not run
+ */
+#define REMOTE_SWDP_VERSION   1
+#define REMOTE_SWDP_BATCH_MAX 32U
 
 /* Start and end of message identifiers */
 #define REMOTE_SOM  '!'
@@ -83,6 +136,7 @@
 #define REMOTE_NRST_SET      'Z'
 #define REMOTE_NRST_GET      'z'
 #define REMOTE_ADD_JTAG_DEV  'J'
+#define REMOTE_BATCH         'B'
 
 /* Protocol response options */
 #define REMOTE_RESP_OK     'K'
@@ -101,6 +155,8 @@
 #define REMOTE_MEM_READ           'h'
 #define REMOTE_MEM_WRITE_SIZED    'H'
 #define REMOTE_AP_MEM_WRITE_SIZED 'm'
+#define REMOTE_AP_MEM_READ_BIN    'r'
+#define REMOTE_AP_MEM_WRITE_BIN   'w'
 
 /* Generic protocol elements */
 #define REMOTE_GEN_PACKET  'G'
@@ -182,6 +238,20 @@
 		REMOTE_SOM, REMOTE_SWDP_PACKET, REMOTE_OUT_PAR, '%', '0', '2', 'x', '%', 'x', REMOTE_EOM, 0 \
 	}
 
+#define REMOTE_SWDP_LOW_ACCESS_STR                                                                           \
+	(char[])                                                                                                 \
+	{                                                                                                        \
+		REMOTE_SOM, REMOTE_SWDP_PACKET, REMOTE_LOW_ACCESS, '%', '0', '2', 'x', '%', '0', '4', 'x', '%', '0', '8', \
+			'x', REMOTE_EOM, 0                                                                               \
+	}
+
+/* Followed by the accesses and REMOTE_EOM */
+#define REMOTE_SWDP_BATCH_STR                                                   \
+	(char[])                                                                    \
+	{                                                                           \
+		REMOTE_SOM, REMOTE_SWDP_PACKET, REMOTE_BATCH, '%', '0', '2', 'x', 0 \
+	}
+
 /* JTAG protocol elements */
 #define REMOTE_JTAG_PACKET 'J'
 #define REMOTE_JTAG_INIT_STR                                                        \
@@ -276,6 +346,18 @@
 		REMOTE_SOM, REMOTE_HL_PACKET, REMOTE_AP_MEM_WRITE_SIZED, '%', '0', '2', 'x', '%', '0', '2', 'x', HEX_U32(csw), \
 			'%', '0', '2', 'x', HEX_U32(address), HEX_U32(count), 0                                                    \
 	}
+#define REMOTE_AP_MEM_READ_BIN_STR                                                                                  \
+	(char[])                                                                                                        \
+	{                                                                                                               \
+		REMOTE_SOM, REMOTE_HL_PACKET, REMOTE_AP_MEM_READ_BIN, '%', '0', '2', 'x', '%', '0', '2', 'x', HEX_U32(csw), \
+			HEX_U32(address), HEX_U32(count), '%', '0', '2', 'x', REMOTE_EOM, 0                                     \
+	}
+#define REMOTE_AP_MEM_WRITE_BIN_STR                                                                                  \
+	(char[])                                                                                                         \
+	{                                                                                                                \
+		REMOTE_SOM, REMOTE_HL_PACKET, REMOTE_AP_MEM_WRITE_BIN, '%', '0', '2', 'x', '%', '0', '2', 'x', HEX_U32(csw), \
+			'%', '0', '2', 'x', HEX_U32(address), HEX_U32(count), '%', '0', '2', 'x', REMOTE_EOM, 0                  \
+	}
 #define REMOTE_MEM_WRITE_SIZED_STR                                                                       \
 	(char[])                                                                                             \
 	{                                                                                                    \
@@ -124,6 +124,9 @@ static const char *const cidc_debug_strings[] = {
 #define DEVTYPE_OFFSET 0xFCCU /* CoreSight Device Type Register */
 #define DEVARCH_OFFSET 0xFBCU /* CoreSight Device Architecture Register */
 
+/* ROM table entries fetched per transaction, divides the 960 entry table evenly */
+#define ADIV5_ROM_ENTRY_CHUNK 8U
+
 #define DEVTYPE_MASK        0x000000FFU
 #define DEVARCH_PRESENT     (1U << 20)
 #define DEVARCH_ARCHID_MASK 0x0000FFFFU
@@ -304,16 +307,22 @@ static uint32_t adiv5_mem_read32(ADIv5_AP_t *ap, uint32_t addr)
 	return ret;
 }
 
-static uint32_t adiv5_ap_read_id(ADIv5_AP_t *ap, uint32_t addr)
+/* ID registers hold one byte each in the bottom of four consecutive words */
+static uint32_t adiv5_id_value(const uint8_t *data)
 {
 	uint32_t res = 0;
-	uint8_t data[16];
-	adiv5_mem_read(ap, data, addr, sizeof(data));
 	for (size_t i = 0; i < 4; ++i)
 		res |= (data[4U * i] << (i * 8U));
 	return res;
 }
 
+static uint32_t adiv5_ap_read_id(ADIv5_AP_t *ap, uint32_t addr)
+{
+	uint8_t data[16];
+	adiv5_mem_read(ap, data, addr, sizeof(data));
+	return adiv5_id_value(data);
+}
+
 uint64_t adiv5_ap_read_pidr(ADIv5_AP_t *ap, uint32_t addr)
 {
 	uint64_t pidr = adiv5_ap_read_id(ap, addr + PIDR4_OFFSET);
@@ -464,7 +473,10 @@ static void adiv5_component_probe(ADIv5_AP_t *ap, uint32_t addr, const size_t re
 	if (addr == 0)       /* No rom table on this AP */
 		return;
 
-	const volatile uint32_t cidr = adiv5_ap_read_id(ap, addr + CIDR0_OFFSET);
+	/* PIDR4-7, PIDR0-3 and CIDR0-3 are contiguous, fetch them in one transaction */
+	uint8_t ids[48];
+	adiv5_mem_read(ap, ids, addr + PIDR4_OFFSET, sizeof(ids));
+	const volatile uint32_t cidr = adiv5_id_value(ids + (CIDR0_OFFSET - PIDR4_OFFSET));
 	if (ap->dp->fault) {
 		DEBUG_WARN("CIDR read timeout on AP%d, aborting.\n", ap->apsel);
 		return;
@@ -494,7 +506,7 @@ static void adiv5_component_probe(ADIv5_AP_t *ap, uint32_t addr, const size_t re
 
 	/* Extract Component ID class nibble */
 	const uint32_t cid_class = (cidr & CID_CLASS_MASK) >> CID_CLASS_SHIFT;
-	const uint64_t pidr = adiv5_ap_read_pidr(ap, addr);
+	const uint64_t pidr = (uint64_t)adiv5_id_value(ids) << 32U | adiv5_id_value(ids + (PIDR0_OFFSET - PIDR4_OFFSET));
 
 	uint16_t designer_code;
 	if (pidr & PIDR_JEP106_USED) {
@@ -549,13 +561,27 @@ static void adiv5_component_probe(ADIv5_AP_t *ap, uint32_t addr, const size_t re
 		DEBUG_INFO("ROM: Table BASE=0x%" PRIx32 " SYSMEM=0x%08" PRIx32 ", Manufacturer %3x Partno %3x\n", addr, memtype,
 			designer_code, part_number);
 #endif
+		uint32_t entries[ADIV5_ROM_ENTRY_CHUNK];
+		bool chunked = false;
 		for (size_t i = 0; i < 960; i++) {
-			adiv5_dp_error(ap->dp);
+			const size_t chunk_offset = i % ADIV5_ROM_ENTRY_CHUNK;
+			if (chunk_offset == 0) {
+				adiv5_dp_error(ap->dp);
+				adiv5_mem_read(ap, entries, addr + i * 4, sizeof(entries));
+				/* Some tables fault on the reserved space past their end, fall back to single reads */
+				chunked = !adiv5_dp_error(ap->dp);
+			}
 
-			uint32_t entry = adiv5_mem_read32(ap, addr + i * 4);
-			if (adiv5_dp_error(ap->dp)) {
-				DEBUG_WARN("%sFault reading ROM table entry %d\n", indent, i);
-				break;
+			uint32_t entry;
+			if (chunked)
+				entry = entries[chunk_offset];
+			else {
+				adiv5_dp_error(ap->dp);
+				entry = adiv5_mem_read32(ap, addr + i * 4);
+				if (adiv5_dp_error(ap->dp)) {
+					DEBUG_WARN("%sFault reading ROM table entry %d\n", indent, i);
+					break;
+				}
 			}
 
 			if (entry == 0)
@@ -703,6 +729,8 @@ void adiv5_dp_init(ADIv5_DP_t *dp, const uint32_t idcode)
 	 *
 	 * for SWD-DP, we are guaranteed to be DP v1 or later.
 	 */
+	/* The DP may be a copy of the one used for scanning, trust no shadowed register */
+	dp->shadow_valid = 0;
 	volatile uint32_t dpidr = 0;
 	volatile struct exception e;
 	TRY_CATCH (e, EXCEPTION_ALL) {
@@ -897,9 +925,52 @@ void adiv5_dp_init(ADIv5_DP_t *dp, const uint32_t idcode)
 #define ALIGNOF(x) (((x)&3) == 0 ? ALIGN_WORD : (((x)&1) == 0 ? ALIGN_HALFWORD : ALIGN_BYTE))
 
 /* Program the CSW and TAR for sequencial access at a given width */
-static void ap_mem_access_setup(ADIv5_AP_t *ap, uint32_t addr, enum align align)
+/* Point SELECT at the AP register bank holding addr, unless the shadow says it already does */
+static void adiv5_ap_select(ADIv5_AP_t *ap, uint16_t addr)
+{
+	ADIv5_DP_t *const dp = ap->dp;
+	const uint32_t select = ((uint32_t)ap->apsel << 24U) | (addr & 0xf0U);
+	if ((dp->shadow_valid & ADIV5_SHADOW_SELECT) && dp->shadow_select == select)
+		return;
+	adiv5_dp_write(dp, ADIV5_DP_SELECT, select);
+	if (!dp->fault) {
+		dp->shadow_select = select;
+		dp->shadow_valid |= ADIV5_SHADOW_SELECT;
+	}
+}
+
+static bool adiv5_ap_shadow_matches(const ADIv5_AP_t *ap, uint8_t shadow, uint32_t value)
 {
-	uint32_t csw = ap->csw | ADIV5_AP_CSW_ADDRINC_SINGLE;
+	const ADIv5_DP_t *const dp = ap->dp;
+	if (dp->shadow_apsel != ap->apsel || !(dp->shadow_valid & shadow))
+		return false;
+	return (shadow == ADIV5_SHADOW_CSW ? dp->shadow_csw : dp->shadow_tar) == value;
+}
+
+static void adiv5_ap_shadow_record(ADIv5_AP_t *ap, uint8_t shadow, uint32_t value)
+{
+	ADIv5_DP_t *const dp = ap->dp;
+	if (dp->fault)
+		return;
+	/* Only one AP's CSW and TAR are tracked at a time */
+	if (dp->shadow_apsel != ap->apsel) {
+		dp->shadow_apsel = ap->apsel;
+		dp->shadow_valid &= ADIV5_SHADOW_SELECT;
+	}
+	if (shadow == ADIV5_SHADOW_CSW)
+		dp->shadow_csw = value;
+	else
+		dp->shadow_tar = value;
+	dp->shadow_valid |= shadow;
+}
+
+/*
+ * Single transfers leave TAR alone so that polling the same register
+ * costs only the DRW access, block transfers auto-increment.
+ */
+static void ap_mem_access_setup(ADIv5_AP_t *ap, uint32_t addr, enum align align, bool increment)
+{
+	uint32_t csw = ap->csw | (increment ? ADIV5_AP_CSW_ADDRINC_SINGLE : ADIV5_AP_CSW_ADDRINC_NONE);
 
 	switch (align) {
 	case ALIGN_BYTE:
@@ -913,8 +984,16 @@ static void ap_mem_access_setup(ADIv5_AP_t *ap, uint32_t addr, enum align align)
 		csw |= ADIV5_AP_CSW_SIZE_WORD;
 		break;
 	}
-	adiv5_ap_write(ap, ADIV5_AP_CSW, csw);
-	adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, addr);
+	/* CSW and TAR both live in bank 0 */
+	adiv5_ap_select(ap, ADIV5_AP_CSW);
+	if (!adiv5_ap_shadow_matches(ap, ADIV5_SHADOW_CSW, csw)) {
+		adiv5_dp_write(ap->dp, ADIV5_AP_CSW, csw);
+		adiv5_ap_shadow_record(ap, ADIV5_SHADOW_CSW, csw);
+	}
+	if (!adiv5_ap_shadow_matches(ap, ADIV5_SHADOW_TAR, addr)) {
+		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, addr);
+		adiv5_ap_shadow_record(ap, ADIV5_SHADOW_TAR, addr);
+	}
 }
 
 /* Extract read data from data lane based on align and src address */
@@ -945,7 +1024,8 @@ void firmware_mem_read(ADIv5_AP_t *ap, void *dest, uint32_t src, size_t len)
 		return;
 
 	len >>= align;
-	ap_mem_access_setup(ap, src, align);
+	const bool increment = len > 1U;
+	ap_mem_access_setup(ap, src, align, increment);
 	adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ, ADIV5_AP_DRW, 0);
 	while (--len) {
 		tmp = adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ, ADIV5_AP_DRW, 0);
@@ -961,14 +1041,22 @@ void firmware_mem_read(ADIv5_AP_t *ap, void *dest, uint32_t src, size_t len)
 	}
 	tmp = adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ, ADIV5_DP_RDBUFF, 0);
 	extract(dest, src, tmp, align);
+
+	/* TAR now sits past the last element, unless that crossed the 10 bit auto-increment limit */
+	if (!increment)
+		adiv5_ap_shadow_record(ap, ADIV5_SHADOW_TAR, src);
+	else if (!(((src + (1U << align)) ^ src) & 0xfffffc00U))
+		adiv5_ap_shadow_record(ap, ADIV5_SHADOW_TAR, src + (1U << align));
 }
 
 void firmware_mem_write_sized(ADIv5_AP_t *ap, uint32_t dest, const void *src, size_t len, enum align align)
 {
+	const uint32_t start = dest;
 	uint32_t odest = dest;
 
 	len >>= align;
-	ap_mem_access_setup(ap, dest, align);
+	const bool increment = len > 1U;
+	ap_mem_access_setup(ap, dest, align, increment);
 	while (len--) {
 		uint32_t tmp = 0;
 		/* Pack data into correct data lane */
@@ -996,22 +1084,126 @@ void firmware_mem_write_sized(ADIv5_AP_t *ap, uint32_t dest, const void *src, si
 	}
 	/* Make sure this write is complete by doing a dummy read */
 	adiv5_dp_read(ap->dp, ADIV5_DP_RDBUFF);
+
+	/* Every 10 bit wrap rewrote TAR, so it ends at dest unless it never moved */
+	adiv5_ap_shadow_record(
+		ap, ADIV5_SHADOW_TAR, increment || ((dest ^ start) & 0xfffffc00U) ? dest : start);
 }
 
 void firmware_ap_write(ADIv5_AP_t *ap, uint16_t addr, uint32_t value)
 {
-	adiv5_dp_write(ap->dp, ADIV5_DP_SELECT, ((uint32_t)ap->apsel << 24) | (addr & 0xF0));
+	adiv5_ap_select(ap, addr);
 	adiv5_dp_write(ap->dp, addr, value);
 }
 
 uint32_t firmware_ap_read(ADIv5_AP_t *ap, uint16_t addr)
 {
 	uint32_t ret;
-	adiv5_dp_write(ap->dp, ADIV5_DP_SELECT, ((uint32_t)ap->apsel << 24) | (addr & 0xF0));
+	adiv5_ap_select(ap, addr);
 	ret = adiv5_dp_read(ap->dp, addr);
 	return ret;
 }
 
+#if PC_HOSTED == 1
+static void adiv5_queue_push(
+	ADIv5_DP_t *dp, ADIv5_AP_t *ap, uint16_t addr, bool read, uint32_t value, uint32_t *result)
+{
+	if (dp->queue_count == ADIV5_QUEUE_DEPTH)
+		adiv5_queue_flush(dp);
+	adiv5_queued_access_s *const access = &dp->queue[dp->queue_count++];
+	access->ap = ap;
+	access->addr = addr;
+	access->read = read;
+	access->value = value;
+	access->result = result;
+}
+
+void adiv5_queue_dp_read(ADIv5_DP_t *dp, uint16_t addr, uint32_t *result)
+{
+	adiv5_queue_push(dp, NULL, addr, true, 0, result);
+}
+
+void adiv5_queue_dp_write(ADIv5_DP_t *dp, uint16_t addr, uint32_t value)
+{
+	adiv5_queue_push(dp, NULL, addr, false, value, NULL);
+}
+
+void adiv5_queue_ap_read(ADIv5_AP_t *ap, uint16_t addr, uint32_t *result)
+{
+	adiv5_queue_push(ap->dp, ap, addr, true, 0, result);
+}
+
+void adiv5_queue_ap_write(ADIv5_AP_t *ap, uint16_t addr, uint32_t value)
+{
+	adiv5_queue_push(ap->dp, ap, addr, false, value, NULL);
+}
+
+/*
+ * Rewrite queued accesses as DP-level ones for probes that batch raw transfers:
+ * AP accesses get their SELECT write inserted and become banked raw accesses.
+ * raw must have room for twice count entries. Returns the number written.
+ */
+size_t adiv5_queue_expand(const adiv5_queued_access_s *accesses, size_t count, adiv5_queued_access_s *raw)
+{
+	size_t raw_count = 0;
+	/* SELECT is unknown on entry, so the first AP access always sets it */
+	bool select_valid = false;
+	uint32_t select = 0;
+	for (size_t i = 0; i < count; ++i) {
+		const adiv5_queued_access_s *const access = &accesses[i];
+		adiv5_queued_access_s *const out = &raw[raw_count];
+		if (access->ap) {
+			const uint32_t ap_select = ((uint32_t)access->ap->apsel << 24U) | (access->addr & 0xf0U);
+			if (!select_valid || select != ap_select) {
+				*out = (adiv5_queued_access_s){NULL, ADIV5_DP_SELECT, false, ap_select, NULL};
+				++raw_count;
+				select = ap_select;
+				select_valid = true;
+			}
+			raw[raw_count] = *access;
+			raw[raw_count].ap = NULL;
+			raw[raw_count].addr |= ADIV5_APnDP;
+		} else {
+			if (access->addr == ADIV5_DP_SELECT && !access->read) {
+				select = access->value;
+				select_valid = true;
+			}
+			*out = *access;
+		}
+		++raw_count;
+	}
+	return raw_count;
+}
+
+void adiv5_queue_flush(ADIv5_DP_t *dp)
+{
+	const size_t count = dp->queue_count;
+	if (!count)
+		return;
+	/* Empty the queue first so an exception part way through leaves nothing stale behind */
+	dp->queue_count = 0;
+	if (dp->queue_flush) {
+		/* The probe moves SELECT behind the shadows' back */
+		dp->shadow_valid = 0;
+		dp->queue_flush(dp, dp->queue, count);
+		return;
+	}
+	/* No batching support in the probe, issue the accesses one at a time */
+	for (size_t i = 0; i < count; ++i) {
+		const adiv5_queued_access_s *const access = &dp->queue[i];
+		if (access->ap) {
+			if (access->read)
+				*access->result = adiv5_ap_read(access->ap, access->addr);
+			else
+				adiv5_ap_write(access->ap, access->addr, access->value);
+		} else if (access->read)
+			*access->result = adiv5_dp_read(dp, access->addr);
+		else
+			adiv5_dp_write(dp, access->addr, access->value);
+	}
+}
+#endif
+
 void adiv5_mem_write(ADIv5_AP_t *ap, uint32_t dest, const void *src, size_t len)
 {
 	enum align align = MIN(ALIGNOF(dest), ALIGNOF(len));
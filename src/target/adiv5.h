@@ -235,6 +235,24 @@ enum align {
 
 typedef struct ADIv5_AP_s ADIv5_AP_t;
 
+/* Which of the DP's register shadows currently match the hardware */
+#define ADIV5_SHADOW_SELECT (1U << 0U)
+#define ADIV5_SHADOW_CSW    (1U << 1U)
+#define ADIV5_SHADOW_TAR    (1U << 2U)
+
+/* Depth of the deferred access queue, see adiv5_queue_*() */
+#define ADIV5_QUEUE_DEPTH 16U
+
+/* A deferred DP/AP access. ap is NULL for raw DP (or already selected AP bank)
+ * accesses, otherwise SELECT is set up for the AP register before the access. */
+typedef struct adiv5_queued_access {
+	ADIv5_AP_t *ap;
+	uint16_t addr;
+	bool read;
+	uint32_t value;
+	uint32_t *result;
+} adiv5_queued_access_s;
+
 /* Try to keep this somewhat absract for later adding SW-DP */
 typedef struct ADIv5_DP_s {
 	int refcnt;
@@ -259,6 +277,10 @@ typedef struct ADIv5_DP_s {
 	void (*ap_reg_write)(ADIv5_AP_t *ap, int num, uint32_t value);
 	void (*read_block)(uint32_t addr, uint8_t *data, int size);
 	void (*dap_write_block_sized)(uint32_t addr, uint8_t *data, int size, enum align align);
+	/* Optional: issue a batch of queued accesses in as few probe transactions as possible */
+	void (*queue_flush)(struct ADIv5_DP_s *dp, const adiv5_queued_access_s *accesses, size_t count);
+	adiv5_queued_access_s queue[ADIV5_QUEUE_DEPTH];
+	uint8_t queue_count;
 #endif
 	uint32_t (*ap_read)(ADIv5_AP_t *ap, uint16_t addr);
 	void (*ap_write)(ADIv5_AP_t *ap, uint16_t addr, uint32_t value);
@@ -268,6 +290,13 @@ typedef struct ADIv5_DP_s {
 	uint8_t dp_jd_index;
 	uint8_t fault;
 
+	/* Shadows of SELECT and of CSW/TAR in AP shadow_apsel, see ADIV5_SHADOW_* */
+	uint8_t shadow_valid;
+	uint8_t shadow_apsel;
+	uint32_t shadow_select;
+	uint32_t shadow_csw;
+	uint32_t shadow_tar;
+
 	/* targetsel DPv2 */
 	uint8_t instance;
 	uint32_t targetsel;
@@ -304,24 +333,58 @@ struct ADIv5_AP_s {
 
 uint8_t make_packet_request(uint8_t RnW, uint16_t addr);
 
+/* Forget any shadowed register that a raw access is about to change */
+static inline void adiv5_dp_shadow_clobber(ADIv5_DP_t *dp, uint8_t RnW, uint16_t addr, uint32_t value)
+{
+	switch (addr) {
+	case ADIV5_DP_SELECT:
+		if (RnW == ADIV5_LOW_WRITE)
+			dp->shadow_valid &= ~ADIV5_SHADOW_SELECT;
+		break;
+	case ADIV5_DP_ABORT:
+		if (RnW == ADIV5_LOW_WRITE && (value & ADIV5_DP_ABORT_DAPABORT))
+			dp->shadow_valid = 0;
+		break;
+	case ADIV5_AP_CSW:
+		if (RnW == ADIV5_LOW_WRITE)
+			dp->shadow_valid &= ~ADIV5_SHADOW_CSW;
+		break;
+	case ADIV5_AP_TAR:
+		if (RnW == ADIV5_LOW_WRITE)
+			dp->shadow_valid &= ~ADIV5_SHADOW_TAR;
+		break;
+	case ADIV5_AP_DRW:
+		/* Data accesses may auto-increment TAR */
+		dp->shadow_valid &= ~ADIV5_SHADOW_TAR;
+		break;
+	}
+}
+
 #if PC_HOSTED == 0
 static inline uint32_t adiv5_dp_read(ADIv5_DP_t *dp, uint16_t addr)
 {
+	adiv5_dp_shadow_clobber(dp, ADIV5_LOW_READ, addr, 0);
 	return dp->dp_read(dp, addr);
 }
 
 static inline uint32_t adiv5_dp_error(ADIv5_DP_t *dp)
 {
-	return dp->error(dp);
+	const uint32_t err = dp->error(dp);
+	/* Faulted accesses leave SELECT, CSW and TAR in an unknown state */
+	if (err)
+		dp->shadow_valid = 0;
+	return err;
 }
 
 static inline uint32_t adiv5_dp_low_access(struct ADIv5_DP_s *dp, uint8_t RnW, uint16_t addr, uint32_t value)
 {
+	adiv5_dp_shadow_clobber(dp, RnW, addr, value);
 	return dp->low_access(dp, RnW, addr, value);
 }
 
 static inline void adiv5_dp_abort(struct ADIv5_DP_s *dp, uint32_t abort)
 {
+	dp->shadow_valid = 0;
 	return dp->abort(dp, abort);
 }
 
@@ -347,6 +410,7 @@ static inline void adiv5_mem_write_sized(ADIv5_AP_t *ap, uint32_t dest, const vo
 
 static inline void adiv5_dp_write(ADIv5_DP_t *dp, uint16_t addr, uint32_t value)
 {
+	adiv5_dp_shadow_clobber(dp, ADIV5_LOW_WRITE, addr, value);
 	dp->low_access(dp, ADIV5_LOW_WRITE, addr, value);
 }
 
@@ -362,6 +426,56 @@ void adiv5_mem_write_sized(ADIv5_AP_t *ap, uint32_t dest, const void *src, size_
 void adiv5_dp_write(ADIv5_DP_t *dp, uint16_t addr, uint32_t value);
 #endif
 
+/*
+ * Deferred accesses: reads only store to *result once adiv5_queue_flush() returns.
+ * The firmware talks to the wire directly, so there the accesses happen immediately.
+ */
+#if PC_HOSTED == 0
+static inline void adiv5_queue_dp_read(ADIv5_DP_t *dp, uint16_t addr, uint32_t *result)
+{
+	*result = adiv5_dp_read(dp, addr);
+}
+
+static inline void adiv5_queue_dp_write(ADIv5_DP_t *dp, uint16_t addr, uint32_t value)
+{
+	adiv5_dp_write(dp, addr, value);
+}
+
+static inline void adiv5_queue_ap_read(ADIv5_AP_t *ap, uint16_t addr, uint32_t *result)
+{
+	*result = adiv5_ap_read(ap, addr);
+}
+
+static inline void adiv5_queue_ap_write(ADIv5_AP_t *ap, uint16_t addr, uint32_t value)
+{
+	adiv5_ap_write(ap, addr, value);
+}
+
+static inline void adiv5_queue_flush(ADIv5_DP_t *dp)
+{
+	(void)dp;
+}
+
+static inline bool adiv5_queue_batched(ADIv5_DP_t *dp)
+{
+	(void)dp;
+	return false;
+}
+#else
+void adiv5_queue_dp_read(ADIv5_DP_t *dp, uint16_t addr, uint32_t *result);
+void adiv5_queue_dp_write(ADIv5_DP_t *dp, uint16_t addr, uint32_t value);
+void adiv5_queue_ap_read(ADIv5_AP_t *ap, uint16_t addr, uint32_t *result);
+void adiv5_queue_ap_write(ADIv5_AP_t *ap, uint16_t addr, uint32_t value);
+void adiv5_queue_flush(ADIv5_DP_t *dp);
+size_t adiv5_queue_expand(const adiv5_queued_access_s *accesses, size_t count, adiv5_queued_access_s *raw);
+
+/* True when the probe turns a queue flush into a single round trip */
+static inline bool adiv5_queue_batched(ADIv5_DP_t *dp)
+{
+	return dp->queue_flush != NULL;
+}
+#endif
+
 void adiv5_dp_init(ADIv5_DP_t *dp, uint32_t idcode);
 void platform_adiv5_dp_defaults(ADIv5_DP_t *dp);
 ADIv5_AP_t *adiv5_new_ap(ADIv5_DP_t *dp, uint8_t apsel);
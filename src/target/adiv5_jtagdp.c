@@ -104,6 +104,8 @@ uint32_t fw_adiv5_jtagdp_low_access(ADIv5_DP_t *dp, uint8_t RnW, uint16_t addr,
 void adiv5_jtagdp_abort(ADIv5_DP_t *dp, uint32_t abort)
 {
 	uint64_t request = (uint64_t)abort << 3;
+	if (abort & ADIV5_DP_ABORT_DAPABORT)
+		dp->shadow_valid = 0;
 	jtag_dev_write_ir(&jtag_proc, dp->dp_jd_index, IR_ABORT);
 	jtag_dev_shift_dr(&jtag_proc, dp->dp_jd_index, NULL, (const uint8_t *)&request, 35);
 }
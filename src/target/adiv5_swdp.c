@@ -54,6 +54,7 @@ uint8_t make_packet_request(uint8_t RnW, uint16_t addr)
 
 static void dp_line_reset(ADIv5_DP_t *dp)
 {
+	dp->shadow_valid = 0;
 	dp->seq_out(0xFFFFFFFFU, 32U);
 	dp->seq_out(0x0FFFFFFFU, 32U);
 }
@@ -220,6 +221,9 @@ uint32_t firmware_swdp_error(ADIv5_DP_t *dp)
 		clr |= ADIV5_DP_ABORT_WDERRCLR;
 
 	adiv5_dp_write(dp, ADIV5_DP_ABORT, clr);
+	/* Also reached straight from the FAULT retry in firmware_swdp_low_access() */
+	if (err)
+		dp->shadow_valid = 0;
 	dp->fault = 0;
 
 	return err;
@@ -106,6 +106,7 @@ static target_addr_t cortexm_check_watch(target *t);
 #define CORTEXM_MAX_BREAKPOINTS 8U /* architecture says up to 127, no implementation has > 8 */
 
 static int cortexm_hostio_request(target *t);
+static bool cortexm_mem_crc32(target *t, target_addr_t addr, size_t len, uint32_t *crc);
 
 static uint32_t time0_sec = UINT32_MAX; /* sys_clock time origin */
 
@@ -592,9 +593,11 @@ bool cortexm_probe(ADIv5_AP_t *ap)
 	t->halt_poll = cortexm_halt_poll;
 	t->halt_resume = cortexm_halt_resume;
 	t->regs_size = sizeof(regnum_cortex_m);
+	t->reg_width = 4U;
 
 	t->breakwatch_set = cortexm_breakwatch_set;
 	t->breakwatch_clear = cortexm_breakwatch_clear;
+	t->mem_crc32 = cortexm_mem_crc32;
 
 	target_add_commands(t, cortexm_cmd_list, cortexm_driver_str);
 
@@ -865,26 +868,28 @@ static void cortexm_regs_read(target *t, void *data)
 #endif
 	{
 		/* FIXME: Describe what's really going on here */
-		adiv5_ap_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
+		adiv5_queue_ap_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
 
 		/* Map the banked data registers (0x10-0x1c) to the
 		 * debug registers DHCSR, DCRSR, DCRDR and DEMCR respectively */
-		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, CORTEXM_DHCSR);
+		adiv5_queue_dp_write(ap->dp, ADIV5_AP_TAR, CORTEXM_DHCSR);
 
 		/* Walk the regnum_cortex_m array, reading the registers it
-		 * calls out. */
-		adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRSR), regnum_cortex_m[0]);
+		 * calls out. The accesses are queued so batching probes need
+		 * only a few round trips for the whole register file. */
+		adiv5_queue_ap_write(ap, ADIV5_AP_DB(DB_DCRSR), regnum_cortex_m[0]);
 		/* Required to switch banks */
-		*regs++ = adiv5_dp_read(ap->dp, ADIV5_AP_DB(DB_DCRDR));
+		adiv5_queue_dp_read(ap->dp, ADIV5_AP_DB(DB_DCRDR), regs++);
 		for (i = 1; i < sizeof(regnum_cortex_m) / 4; i++) {
-			adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR), regnum_cortex_m[i]);
-			*regs++ = adiv5_dp_read(ap->dp, ADIV5_AP_DB(DB_DCRDR));
+			adiv5_queue_dp_write(ap->dp, ADIV5_AP_DB(DB_DCRSR), regnum_cortex_m[i]);
+			adiv5_queue_dp_read(ap->dp, ADIV5_AP_DB(DB_DCRDR), regs++);
 		}
 		if (t->target_options & TOPT_FLAVOUR_V7MF)
 			for (i = 0; i < sizeof(regnum_cortex_mf) / 4; i++) {
-				adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR), regnum_cortex_mf[i]);
-				*regs++ = adiv5_dp_read(ap->dp, ADIV5_AP_DB(DB_DCRDR));
+				adiv5_queue_dp_write(ap->dp, ADIV5_AP_DB(DB_DCRSR), regnum_cortex_mf[i]);
+				adiv5_queue_dp_read(ap->dp, ADIV5_AP_DB(DB_DCRDR), regs++);
 			}
+		adiv5_queue_flush(ap->dp);
 	}
 }
 
@@ -892,6 +897,7 @@ static void cortexm_regs_write(target *t, const void *data)
 {
 	const uint32_t *regs = data;
 	ADIv5_AP_t *ap = cortexm_ap(t);
+	target_regs_cache_invalidate(t);
 #if PC_HOSTED == 1
 	if (ap->dp->ap_reg_write) {
 		for (size_t z = 0; z < sizeof(regnum_cortex_m) / 4; z++) {
@@ -909,25 +915,26 @@ static void cortexm_regs_write(target *t, const void *data)
 		size_t i;
 
 		/* FIXME: Describe what's really going on here */
-		adiv5_ap_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
+		adiv5_queue_ap_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
 
 		/* Map the banked data registers (0x10-0x1c) to the
 		 * debug registers DHCSR, DCRSR, DCRDR and DEMCR respectively */
-		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, CORTEXM_DHCSR);
+		adiv5_queue_dp_write(ap->dp, ADIV5_AP_TAR, CORTEXM_DHCSR);
 		/* Walk the regnum_cortex_m array, writing the registers it
 		 * calls out. */
-		adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRDR), *regs++);
+		adiv5_queue_ap_write(ap, ADIV5_AP_DB(DB_DCRDR), *regs++);
 		/* Required to switch banks */
-		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR), 0x10000 | regnum_cortex_m[0]);
+		adiv5_queue_dp_write(ap->dp, ADIV5_AP_DB(DB_DCRSR), 0x10000 | regnum_cortex_m[0]);
 		for (i = 1; i < sizeof(regnum_cortex_m) / 4; i++) {
-			adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRDR), *regs++);
-			adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR), 0x10000 | regnum_cortex_m[i]);
+			adiv5_queue_dp_write(ap->dp, ADIV5_AP_DB(DB_DCRDR), *regs++);
+			adiv5_queue_dp_write(ap->dp, ADIV5_AP_DB(DB_DCRSR), 0x10000 | regnum_cortex_m[i]);
 		}
 		if (t->target_options & TOPT_FLAVOUR_V7MF)
 			for (i = 0; i < sizeof(regnum_cortex_mf) / 4; i++) {
-				adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRDR), *regs++);
-				adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR), 0x10000 | regnum_cortex_mf[i]);
+				adiv5_queue_dp_write(ap->dp, ADIV5_AP_DB(DB_DCRDR), *regs++);
+				adiv5_queue_dp_write(ap->dp, ADIV5_AP_DB(DB_DCRSR), 0x10000 | regnum_cortex_mf[i]);
 			}
+		adiv5_queue_flush(ap->dp);
 	}
 }
 
@@ -964,6 +971,7 @@ static ssize_t cortexm_reg_write(target *t, int reg, const void *data, size_t ma
 	if (max < 4)
 		return -1;
 	const uint32_t *r = data;
+	target_regs_cache_invalidate(t);
 	target_mem_write32(t, CORTEXM_DCRDR, *r);
 	target_mem_write32(t, CORTEXM_DCRSR, CORTEXM_DCRSR_REGWnR | dcrsr_regnum(t, reg));
 	return 4;
@@ -977,6 +985,7 @@ static uint32_t cortexm_pc_read(target *t)
 
 static void cortexm_pc_write(target *t, const uint32_t val)
 {
+	target_regs_cache_invalidate(t);
 	target_mem_write32(t, CORTEXM_DCRDR, val);
 	target_mem_write32(t, CORTEXM_DCRSR, CORTEXM_DCRSR_REGWnR | 0x0F);
 }
@@ -985,6 +994,7 @@ static void cortexm_pc_write(target *t, const uint32_t val)
  * using the core debug registers in the NVIC. */
 static void cortexm_reset(target *t)
 {
+	target_regs_cache_invalidate(t);
 	/* Read DHCSR here to clear S_RESET_ST bit before reset */
 	target_mem_read32(t, CORTEXM_DHCSR);
 	platform_timeout reset_timeout;
@@ -994,6 +1004,8 @@ static void cortexm_reset(target *t)
 		/* Some NRF52840 users saw invalid SWD transaction with
 		 * native/firmware without this delay.*/
 		platform_delay(10);
+		/* Some parts reset their debug logic along with the core */
+		cortexm_ap(t)->dp->shadow_valid = 0;
 	}
 	uint32_t dhcsr = target_mem_read32(t, CORTEXM_DHCSR);
 	if ((dhcsr & CORTEXM_DHCSR_S_RESET_ST) == 0) {
@@ -1039,12 +1051,24 @@ static enum target_halt_reason cortexm_halt_poll(target *t, target_addr_t *watch
 {
 	struct cortexm_priv *priv = t->priv;
 
-	volatile uint32_t dhcsr = 0;
+	ADIv5_AP_t *ap = cortexm_ap(t);
+	const bool batched = adiv5_queue_batched(ap->dp);
+	uint32_t dhcsr = 0;
+	uint32_t dfsr = 0;
 	volatile struct exception e;
 	TRY_CATCH (e, EXCEPTION_ALL) {
 		/* If this times out because the target is in WFI then
 		 * the target is still running. */
-		dhcsr = target_mem_read32(t, CORTEXM_DHCSR);
+		if (batched) {
+			/* Fetch DFSR along with DHCSR so a halt costs no extra round trip */
+			adiv5_queue_ap_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
+			adiv5_queue_ap_write(ap, ADIV5_AP_TAR, CORTEXM_DHCSR);
+			adiv5_queue_ap_read(ap, ADIV5_AP_DRW, &dhcsr);
+			adiv5_queue_ap_write(ap, ADIV5_AP_TAR, CORTEXM_DFSR);
+			adiv5_queue_ap_read(ap, ADIV5_AP_DRW, &dfsr);
+			adiv5_queue_flush(ap->dp);
+		} else
+			dhcsr = target_mem_read32(t, CORTEXM_DHCSR);
 	}
 	switch (e.type) {
 	case EXCEPTION_ERROR:
@@ -1060,7 +1084,8 @@ static enum target_halt_reason cortexm_halt_poll(target *t, target_addr_t *watch
 		return TARGET_HALT_RUNNING;
 
 	/* We've halted.  Let's find out why. */
-	uint32_t dfsr = target_mem_read32(t, CORTEXM_DFSR);
+	if (!batched)
+		dfsr = target_mem_read32(t, CORTEXM_DFSR);
 	target_mem_write32(t, CORTEXM_DFSR, dfsr); /* write back to reset */
 
 	if ((dfsr & CORTEXM_DFSR_VCATCH) && cortexm_fault_unwind(t))
@@ -1102,6 +1127,8 @@ static void cortexm_halt_resume(target *t, bool step)
 {
 	struct cortexm_priv *priv = t->priv;
 	uint32_t dhcsr = CORTEXM_DHCSR_DBGKEY | CORTEXM_DHCSR_C_DEBUGEN;
+	/* Stubs are run through here directly, bypassing target_halt_resume() */
+	target_regs_cache_invalidate(t);
 
 	if (step)
 		dhcsr |= CORTEXM_DHCSR_C_STEP | CORTEXM_DHCSR_C_MASKINTS;
@@ -1182,7 +1209,8 @@ static int cortexm_fault_unwind(target *t)
 	return 0;
 }
 
-int cortexm_run_stub(target *t, uint32_t loadaddr, uint32_t r0, uint32_t r1, uint32_t r2, uint32_t r3)
+/* Load the stub's arguments and set it running without waiting for it to finish */
+bool cortexm_start_stub(target *t, uint32_t loadaddr, uint32_t r0, uint32_t r1, uint32_t r2, uint32_t r3)
 {
 	uint32_t regs[t->regs_size / 4U];
 
@@ -1193,22 +1221,25 @@ int cortexm_run_stub(target *t, uint32_t loadaddr, uint32_t r0, uint32_t r1, uin
 	regs[3] = r3;
 	regs[15] = loadaddr;
 	regs[REG_XPSR] = CORTEXM_XPSR_THUMB;
-	regs[19] = 0;
+	/* Run with interrupts masked so a pending application IRQ can't take the core away from the stub */
+	regs[REG_SPECIAL] = CORTEXM_SPECIAL_PRIMASK;
 
 	cortexm_regs_write(t, regs);
 
 	if (target_check_error(t))
-		return -1;
+		return false;
 
 	/* Execute the stub */
-	enum target_halt_reason reason;
-#if defined(PLATFORM_HAS_DEBUG)
-	uint32_t arm_regs_start[t->regs_size];
-	target_regs_read(t, arm_regs_start);
-#endif
 	cortexm_halt_resume(t, 0);
+	return true;
+}
+
+/* Wait for a running stub to exit, returning its exit code or a negative value on failure */
+int cortexm_wait_stub(target *t, uint32_t timeout_ms)
+{
+	enum target_halt_reason reason;
 	platform_timeout timeout;
-	platform_timeout_set(&timeout, 5000);
+	platform_timeout_set(&timeout, timeout_ms);
 	do {
 		if (platform_timeout_is_expired(&timeout)) {
 			cortexm_halt_request(t);
@@ -1217,7 +1248,7 @@ int cortexm_run_stub(target *t, uint32_t loadaddr, uint32_t r0, uint32_t r1, uin
 			uint32_t arm_regs[t->regs_size];
 			target_regs_read(t, arm_regs);
 			for (size_t i = 0; i < 20; i++) {
-				DEBUG_WARN("%2d: %08" PRIx32 ", %08" PRIx32 "\n", i, arm_regs_start[i], arm_regs[i]);
+				DEBUG_WARN("%2d: %08" PRIx32 "\n", i, arm_regs[i]);
 			}
 #endif
 			return -3;
@@ -1239,6 +1270,75 @@ int cortexm_run_stub(target *t, uint32_t loadaddr, uint32_t r0, uint32_t r1, uin
 	return bkpt_instr & 0xffU;
 }
 
+/* Halt a stub that may still be running, false if the core did not halt within timeout_ms */
+bool cortexm_stop_stub(target *t, uint32_t timeout_ms)
+{
+	platform_timeout timeout;
+	platform_timeout_set(&timeout, timeout_ms);
+	cortexm_halt_request(t);
+	enum target_halt_reason reason;
+	while ((reason = cortexm_halt_poll(t, NULL)) == TARGET_HALT_RUNNING) {
+		if (platform_timeout_is_expired(&timeout))
+			return false;
+	}
+	return reason != TARGET_HALT_ERROR;
+}
+
+int cortexm_run_stub(target *t, uint32_t loadaddr, uint32_t r0, uint32_t r1, uint32_t r2, uint32_t r3)
+{
+	if (!cortexm_start_stub(t, loadaddr, r0, r1, r2, r3))
+		return -1;
+	return cortexm_wait_stub(t, 5000);
+}
+
+static const uint16_t cortexm_crc32_stub[] = {
+#include "flashstub/crc32.stub"
+};
+
+/*
+ * Have the core compute the CRC of a memory range so only the result crosses the wire.
+ * The stub's RAM and the core registers are put back afterwards, which makes this
+ * usable in the middle of a debug session as well as for verifying a Flash load.
+ */
+static bool cortexm_mem_crc32(target *t, target_addr_t addr, size_t len, uint32_t *crc)
+{
+	struct cortexm_priv *priv = t->priv;
+	if (!(target_mem_read32(t, CORTEXM_DHCSR) & CORTEXM_DHCSR_S_HALT))
+		return false;
+
+	struct target_ram *ram = t->ram;
+	while (ram && ram->length < sizeof(cortexm_crc32_stub))
+		ram = ram->next;
+	/* The stub would see its own code in place of the memory it covers */
+	if (!ram || (addr < ram->start + sizeof(cortexm_crc32_stub) && ram->start < addr + len))
+		return false;
+
+	uint8_t saved_ram[sizeof(cortexm_crc32_stub)];
+	uint32_t saved_regs[t->regs_size / 4U];
+	const bool on_bkpt = priv->on_bkpt;
+	cortexm_regs_read(t, saved_regs);
+	if (target_mem_read(t, saved_ram, ram->start, sizeof(saved_ram)) ||
+		target_mem_write(t, ram->start, cortexm_crc32_stub, sizeof(cortexm_crc32_stub)))
+		return false;
+
+	/* Allow for a core as slow as 1 ms per 64 bytes */
+	int result = -1;
+	if (cortexm_start_stub(t, ram->start, addr, len, 0, 0))
+		result = cortexm_wait_stub(t, 1000U + len / 64U);
+	if (result == 0)
+		cortexm_reg_read(t, 0, crc, sizeof(*crc));
+	/* A timed out stub has only been asked to halt, it must stop before its RAM and registers go back */
+	else if (result == -3 && !cortexm_stop_stub(t, 100U)) {
+		DEBUG_WARN("CRC stub did not halt\n");
+		return false;
+	}
+
+	target_mem_write(t, ram->start, saved_ram, sizeof(saved_ram));
+	cortexm_regs_write(t, saved_regs);
+	priv->on_bkpt = on_bkpt;
+	return result == 0 && !target_check_error(t);
+}
+
 /* The following routines implement hardware breakpoints and watchpoints.
  * The Flash Patch and Breakpoint (FPB) and Data Watch and Trace (DWT)
  * systems are used. */
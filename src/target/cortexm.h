@@ -170,6 +170,8 @@ extern unsigned cortexm_wait_timeout;
 
 #define ARM_THUMB_BREAKPOINT 0xbe00U
 #define CORTEXM_XPSR_THUMB   (1U << 24U)
+/* PRIMASK lives in bits 7:0 of the special register, alongside BASEPRI, FAULTMASK and CONTROL */
+#define CORTEXM_SPECIAL_PRIMASK (1U << 0U)
 
 #define CORTEXM_TOPT_INHIBIT_NRST (1U << 2U)
 
@@ -190,6 +192,9 @@ ADIv5_AP_t *cortexm_ap(target *t);
 bool cortexm_attach(target *t);
 void cortexm_detach(target *t);
 int cortexm_run_stub(target *t, uint32_t loadaddr, uint32_t r0, uint32_t r1, uint32_t r2, uint32_t r3);
+bool cortexm_start_stub(target *t, uint32_t loadaddr, uint32_t r0, uint32_t r1, uint32_t r2, uint32_t r3);
+int cortexm_wait_stub(target *t, uint32_t timeout_ms);
+bool cortexm_stop_stub(target *t, uint32_t timeout_ms);
 int cortexm_mem_write_sized(target *t, target_addr_t dest, const void *src, size_t len, enum align align);
 
 #endif /* TARGET_CORTEXM_H */
@@ -0,0 +1,166 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This file implements streaming of Flash writes through an on-target loader.
+ *
+ * The loader stub runs for the whole of a Flash operation. The probe fills a
+ * ring of RAM buffers and bumps the write index in the mailbox; the stub
+ * programs each buffer in turn and bumps the read index, so the transfer of
+ * one buffer overlaps the programming of the previous one. RAM layout from
+ * ram_base:
+ *
+ *   stub code, padded to a word
+ *   mailbox: write index, read index, status, stop, buffer size, buffer count
+ *   ring: buffer_count times { destination, length, data[buffer_size] }
+ *
+ * The stub exits with bkpt 0 once asked to stop and the ring is empty, or
+ * stores a non-zero status and exits with another code on a programming error.
+ */
+
+#include "general.h"
+#include "target_internal.h"
+#include "cortexm.h"
+
+#define LOADER_WRITE_IDX   0x00U
+#define LOADER_READ_IDX    0x04U
+#define LOADER_STATUS      0x08U
+#define LOADER_STOP        0x0cU
+#define LOADER_RING        0x18U
+#define LOADER_SLOT_HEADER 8U
+
+#define LOADER_TIMEOUT_MS 5000U
+#define LOADER_HALT_TIMEOUT_MS 100U
+
+static target_addr_t flash_loader_mailbox(const flash_loader_s *loader)
+{
+	return loader->ram_base + ALIGN(loader->stub_size, 4U);
+}
+
+static bool flash_loader_start(target_flash_s *f)
+{
+	target *t = f->t;
+	const flash_loader_s *loader = f->loader;
+	const target_addr_t mailbox = flash_loader_mailbox(loader);
+	const uint32_t header[6] = {0, 0, 0, 0, loader->buffer_size, loader->buffer_count};
+
+	if (target_mem_write(t, loader->ram_base, loader->stub, loader->stub_size) ||
+		target_mem_write(t, mailbox, header, sizeof(header)) ||
+		!cortexm_start_stub(t, loader->ram_base, mailbox, loader->arg, 0, 0))
+		return false;
+
+	f->loader_running = true;
+	f->loader_queued = 0;
+	return true;
+}
+
+/* Halt the loader if it is still running and forget about it */
+static void flash_loader_abort(target_flash_s *f)
+{
+	if (!cortexm_stop_stub(f->t, LOADER_HALT_TIMEOUT_MS))
+		DEBUG_WARN("Flash loader did not halt\n");
+	f->loader_running = false;
+}
+
+/* Wait until no more than max_pending of the queued buffers are still to be programmed */
+static bool flash_loader_wait(target_flash_s *f, uint32_t max_pending)
+{
+	target *t = f->t;
+	const target_addr_t mailbox = flash_loader_mailbox(f->loader);
+	platform_timeout timeout;
+	platform_timeout_set(&timeout, LOADER_TIMEOUT_MS);
+
+	while (true) {
+		uint32_t state[3];
+		++t->flash_stats.status_polls;
+		if (target_mem_read(t, state, mailbox, sizeof(state)))
+			return false;
+		if (state[LOADER_STATUS / 4U]) {
+			DEBUG_WARN("Flash loader error 0x%08" PRIx32 "\n", state[LOADER_STATUS / 4U]);
+			return false;
+		}
+		if (f->loader_queued - state[LOADER_READ_IDX / 4U] <= max_pending)
+			return true;
+		if (platform_timeout_is_expired(&timeout)) {
+			DEBUG_WARN("Flash loader timed out\n");
+			return false;
+		}
+	}
+}
+
+bool flash_loader_write(target_flash_s *f, target_addr_t dest, const void *src, size_t len)
+{
+	if (f->loader_failed)
+		return f->write(f, dest, src, len);
+	if (!f->loader_running && !flash_loader_start(f)) {
+		DEBUG_WARN("Flash loader failed to start, writing directly\n");
+		f->loader_failed = true;
+		return f->write(f, dest, src, len);
+	}
+
+	target *t = f->t;
+	const flash_loader_s *loader = f->loader;
+	const target_addr_t mailbox = flash_loader_mailbox(loader);
+	const uint8_t *data = src;
+	while (len) {
+		/* Wait for a free buffer, the others may still be getting programmed meanwhile */
+		if (!flash_loader_wait(f, loader->buffer_count - 1U)) {
+			flash_loader_abort(f);
+			return false;
+		}
+
+		const size_t chunk = MIN(len, loader->buffer_size);
+		const uint32_t slot_index = f->loader_queued & (loader->buffer_count - 1U);
+		const target_addr_t slot =
+			mailbox + LOADER_RING + slot_index * (loader->buffer_size + LOADER_SLOT_HEADER);
+		const uint32_t header[2] = {dest, chunk};
+		if (target_mem_write(t, slot, header, sizeof(header)) ||
+			target_mem_write(t, slot + LOADER_SLOT_HEADER, data, chunk)) {
+			flash_loader_abort(f);
+			return false;
+		}
+		target_mem_write32(t, mailbox + LOADER_WRITE_IDX, ++f->loader_queued);
+
+		dest += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
+/* Let the loader finish the queued buffers and exit, reporting whether they all programmed */
+bool flash_loader_stop(target_flash_s *f)
+{
+	if (!f->loader_running)
+		return true;
+
+	/* The loader finishing off its queue is still programming time */
+	const uint32_t start_time = platform_time_ms();
+	target_mem_write32(f->t, flash_loader_mailbox(f->loader) + LOADER_STOP, 1U);
+	const bool drained = flash_loader_wait(f, 0);
+	bool result;
+	if (drained)
+		result = cortexm_wait_stub(f->t, LOADER_TIMEOUT_MS) == 0;
+	else {
+		/* The loader may still be running, it must be halted before anything else touches the Flash */
+		result = false;
+		if (!cortexm_stop_stub(f->t, LOADER_HALT_TIMEOUT_MS))
+			DEBUG_WARN("Flash loader did not halt\n");
+	}
+	f->loader_running = false;
+	f->t->flash_stats.write_ms += platform_time_ms() - start_time;
+	return result;
+}
@@ -0,0 +1,56 @@
+@ This file is part of the Black Magic Debug project.
+@
+@ This program is free software: you can redistribute it and/or modify
+@ it under the terms of the GNU General Public License as published by
+@ the Free Software Foundation, either version 3 of the License, or
+@ (at your option) any later version.
+@
+@ CRC-32 of target memory as GDB's qCRC packet defines it: polynomial
+@ 0x04C11DB7, initial value 0xFFFFFFFF, MSB first, no final inversion.
+@ Entered with r0 = address, r1 = length, exits with the CRC in r0.
+@ Works a nibble at a time from a 16 entry table to keep the stub small.
+
+	.syntax unified
+	.cpu cortex-m0
+	.thumb
+
+	.global crc32
+crc32:
+	cpsid i
+	adr r3, table
+	movs r2, #0
+	mvns r2, r2
+	cmp r1, #0
+	beq done
+loop:
+	ldrb r4, [r0]
+	adds r0, #1
+	@ High nibble
+	lsrs r5, r2, #28
+	lsrs r6, r4, #4
+	eors r5, r6
+	lsls r5, r5, #2
+	ldr r5, [r3, r5]
+	lsls r2, r2, #4
+	eors r2, r5
+	@ Low nibble
+	lsrs r5, r2, #28
+	lsls r6, r4, #28
+	lsrs r6, r6, #28
+	eors r5, r6
+	lsls r5, r5, #2
+	ldr r5, [r3, r5]
+	lsls r2, r2, #4
+	eors r2, r5
+	subs r1, #1
+	bne loop
+done:
+	mov r0, r2
+	bkpt #0
+
+	.align 2
+table:
+	.word 0x00000000, 0x04c11db7, 0x09823b6e, 0x0d4326d9
+	.word 0x130476dc, 0x17c56b6b, 0x1a864db2, 0x1e475005
+	.word 0x2608edb8, 0x22c9f00f, 0x2f8ad6d6, 0x2b4bcb61
+	.word 0x350c9b64, 0x31cd86d3, 0x3c8ea00a, 0x384fbdbd
@@ -0,0 +1,93 @@
+@ This file is part of the Black Magic Debug project.
+@
+@ This program is free software: you can redistribute it and/or modify
+@ it under the terms of the GNU General Public License as published by
+@ the Free Software Foundation, either version 3 of the License, or
+@ (at your option) any later version.
+@
+@ Streaming flash loader for the STM32F0/F1/F3 flash controller, driven by
+@ target/flash_loader.c. Mailbox layout, in words:
+@   write index, read index, status, stop, buffer size, buffer count
+@ followed by the ring of buffer count slots, each
+@   destination, length, data[buffer size]
+@ Entered with r0 = mailbox, r1 = flash controller base.
+
+	.syntax unified
+	.cpu cortex-m0
+	.thumb
+
+	.equ WRITE_IDX, 0
+	.equ READ_IDX, 4
+	.equ STATUS, 8
+	.equ STOP, 12
+	.equ BUF_SIZE, 16
+	.equ BUF_COUNT, 20
+	.equ RING, 24
+
+	.equ FLASH_SR, 0x0c
+	.equ FLASH_CR, 0x10
+	.equ FLASH_SR_BSY, 0x01
+	.equ FLASH_SR_CLEAR, 0x34
+	.equ FLASH_SR_ERROR, 0x14
+	.equ FLASH_CR_PG, 0x01
+
+	.global stm32f1_flash_loader
+	.type stm32f1_flash_loader, %function
+stm32f1_flash_loader:
+idle:
+	ldr r2, [r0, #READ_IDX]
+	ldr r3, [r0, #WRITE_IDX]
+	cmp r2, r3
+	bne program
+	ldr r3, [r0, #STOP]
+	cmp r3, #0
+	beq idle
+	bkpt #0
+
+program:
+	@ r3 = slot = ring + (read_idx & (count - 1)) * (size + 8)
+	ldr r3, [r0, #BUF_COUNT]
+	subs r3, #1
+	ands r3, r2
+	ldr r4, [r0, #BUF_SIZE]
+	adds r4, #8
+	muls r3, r4, r3
+	adds r3, r0
+	adds r3, #RING
+	ldr r4, [r3, #0]
+	ldr r5, [r3, #4]
+	adds r3, #8
+
+	movs r6, #FLASH_SR_CLEAR
+	str r6, [r1, #FLASH_SR]
+	movs r6, #FLASH_CR_PG
+	str r6, [r1, #FLASH_CR]
+	movs r7, #FLASH_SR_BSY
+halfword:
+	cmp r5, #0
+	beq slot_done
+	ldrh r6, [r3]
+	strh r6, [r4]
+busy:
+	ldr r6, [r1, #FLASH_SR]
+	tst r6, r7
+	bne busy
+	adds r3, #2
+	adds r4, #2
+	subs r5, #2
+	b halfword
+
+slot_done:
+	movs r6, #0
+	str r6, [r1, #FLASH_CR]
+	ldr r6, [r1, #FLASH_SR]
+	movs r7, #FLASH_SR_ERROR
+	ands r6, r7
+	bne error
+	adds r2, #1
+	str r2, [r0, #READ_IDX]
+	b idle
+
+error:
+	str r6, [r0, #STATUS]
+	bkpt #1
@@ -245,6 +245,7 @@ static void rp_add_flash(target *t)
 	f->length = spi_parameters.capacity;
 	f->blocksize = spi_parameters.sector_size;
 	f->erase = rp_flash_erase;
+	f->erase_max = spi_parameters.capacity; /* rp_flash_erase() picks 32k/64k block erases itself */
 	f->write = rp_flash_write;
 	f->writesize = MAX_WRITE_CHUNK; /* Max buffer size used otherwise */
 	f->erased = 0xffU;
@@ -94,6 +94,20 @@ static bool stm32f1_mass_erase(target *t);
 #define FLASHSIZE    0x1FFFF7E0
 #define FLASHSIZE_F0 0x1FFFF7CC
 
+static const uint16_t stm32f1_flash_loader_stub[] = {
+#include "flashstub/stm32f1_loader.stub"
+};
+
+/* Streams writes to bank 1 through two 1kiB buffers, 2.2kiB of RAM in all */
+static const flash_loader_s stm32f1_flash_loader = {
+	.stub = stm32f1_flash_loader_stub,
+	.stub_size = sizeof(stm32f1_flash_loader_stub),
+	.ram_base = 0x20000000,
+	.buffer_size = 1024,
+	.buffer_count = 2,
+	.arg = FPEC_BASE,
+};
+
 static void stm32f1_add_flash(target *t, uint32_t addr, size_t length, size_t erasesize)
 {
 	target_flash_s *f = calloc(1, sizeof(*f));
@@ -109,6 +123,8 @@ static void stm32f1_add_flash(target *t, uint32_t addr, size_t length, size_t er
 	f->write = stm32f1_flash_write;
 	f->writesize = erasesize;
 	f->erased = 0xff;
+	if (addr < FLASH_BANK_SPLIT)
+		f->loader = &stm32f1_flash_loader;
 	target_add_flash(t, f);
 }
 
@@ -377,6 +393,7 @@ static bool stm32f1_flash_busy_wait(target *const t, const uint32_t bank_offset,
 	 * https://www.st.com/resource/en/programming_manual/pm0075-stm32f10xxx-flash-memory-microcontrollers-stmicroelectronics.pdf
 	 */
 	while (!(status & SR_EOP) && (status & FLASH_SR_BSY)) {
+		++t->flash_stats.status_polls;
 		status = target_mem_read32(t, FLASH_SR + bank_offset);
 		if (target_check_error(t)) {
 			DEBUG_WARN("Lost communications with target");
@@ -398,6 +398,7 @@ static bool stm32f4_flash_busy_wait(target *t)
 	/* Read FLASH_SR to poll for BSY bit */
 	uint32_t sr;
 	do {
+		++t->flash_stats.status_polls;
 		sr = target_mem_read32(t, FLASH_SR);
 		if ((sr & SR_ERROR_MASK) || target_check_error(t)) {
 			DEBUG_WARN("stm32f4 flash error 0x%" PRIx32 "\n", sr);
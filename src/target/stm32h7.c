@@ -55,6 +55,9 @@ const struct command_s stm32h7_cmd_list[] = {
 static bool stm32h7_flash_erase(target_flash_s *f, target_addr_t addr, size_t len);
 static bool stm32h7_flash_write(target_flash_s *f, target_addr_t dest, const void *src, size_t len);
 static bool stm32h7_mass_erase(target *t);
+static size_t stm32h7_flash_erase_start(target_flash_s *f, target_addr_t addr, size_t len);
+static bool stm32h7_flash_erase_poll(target_flash_s *f, bool *done);
+static bool stm32h7_flash_crc(target_flash_s *f, target_addr_t addr, size_t len, uint32_t *crc);
 
 static const char stm32h7_driver_str[] = "STM32H7";
 
@@ -69,6 +72,8 @@ enum stm32h7_regs {
 	FLASH_OPTSR_CUR = 0x1C,
 	FLASH_OPTSR     = 0x20,
 	FLASH_CRCCR		= 0x50,
+	FLASH_CRCSADD	= 0x54,
+	FLASH_CRCEADD	= 0x58,
 	FLASH_CRCDATA	= 0x5C,
 };
 
@@ -144,6 +149,7 @@ enum stm32h7_regs {
 #define NUM_SECTOR_PER_BANK 8
 #define FLASH_SECTOR_SIZE 	0x20000
 #define BANK2_START         0x08100000
+#define FLASH_WORD_SIZE     32U
 enum ID_STM32H7 {
 	ID_STM32H74x  = 0x4500,      /* RM0433, RM0399 */
 	ID_STM32H7Bx  = 0x4800,      /* RM0455 */
@@ -173,7 +179,12 @@ static void stm32h7_add_flash(target *t, uint32_t addr, size_t length, size_t bl
 	f->length = length;
 	f->blocksize = blocksize;
 	f->erase = stm32h7_flash_erase;
+	f->in_mass_erase = true;
+	/* Each bank has its own controller, so one can erase while the other programs */
+	f->erase_start = stm32h7_flash_erase_start;
+	f->erase_poll = stm32h7_flash_erase_poll;
 	f->write = stm32h7_flash_write;
+	f->crc = stm32h7_flash_crc;
 	f->writesize = 2048;
 	f->erased = 0xff;
 	sf->regbase = FPEC1_BASE;
@@ -247,6 +258,7 @@ static bool stm32h7_flash_busy_wait(target *t, uint32_t regbase)
 {
 	uint32_t sr;
 	do {
+		++t->flash_stats.status_polls;
 		sr = target_mem_read32(t, regbase + FLASH_SR);
 		if ((sr & FLASH_SR_ERROR_MASK) || target_check_error(t)) {
 			DEBUG_WARN("stm32h7_flash_write: error sr %08" PRIx32 "\n", sr);
@@ -305,6 +317,56 @@ static bool stm32h7_flash_erase(target_flash_s *f, target_addr_t addr, size_t le
 	return true;
 }
 
+static bool stm32h7_erase_bank(target *const t, const enum align psize,
+	const uint32_t start_addr, const uint32_t reg_base)
+{
+	if (!stm32h7_flash_unlock(t, start_addr)) {
+		DEBUG_WARN("bank erase: Unlock failed\n");
+		return false;
+	}
+	/* BER and start can be merged (3.3.10).*/
+	const uint32_t ctrl_reg = (psize * FLASH_CR_PSIZE16) | FLASH_CR_BER | FLASH_CR_START;
+	target_mem_write32(t, reg_base + FLASH_CR, ctrl_reg);
+	DEBUG_INFO("bank erase started at %08" PRIx32 "\n", start_addr);
+	return true;
+}
+
+/* Start erasing the whole bank, or else the sector at addr, without waiting for it */
+static size_t stm32h7_flash_erase_start(target_flash_s *f, target_addr_t addr, size_t len)
+{
+	target *t = f->t;
+	struct stm32h7_flash *sf = (struct stm32h7_flash *)f;
+	/* We come out of reset with HSI 64 MHz. Adapt FLASH_ACR.*/
+	target_mem_write32(t, sf->regbase + FLASH_ACR, 0);
+
+	if (addr == f->start && len >= f->length)
+		return stm32h7_erase_bank(t, sf->psize, addr, sf->regbase) ? f->length : 0;
+
+	if (!stm32h7_flash_unlock(t, addr))
+		return 0;
+
+	const size_t sector = (addr & ((NUM_SECTOR_PER_BANK * FLASH_SECTOR_SIZE) - 1)) / FLASH_SECTOR_SIZE;
+	uint32_t ctrl_reg = (sf->psize * FLASH_CR_PSIZE16) | FLASH_CR_SER | (sector * FLASH_CR_SNB_1);
+	target_mem_write32(t, sf->regbase + FLASH_CR, ctrl_reg);
+	ctrl_reg |= FLASH_CR_START;
+	target_mem_write32(t, sf->regbase + FLASH_CR, ctrl_reg);
+	return FLASH_SECTOR_SIZE;
+}
+
+static bool stm32h7_flash_erase_poll(target_flash_s *f, bool *done)
+{
+	target *t = f->t;
+	struct stm32h7_flash *sf = (struct stm32h7_flash *)f;
+	const uint32_t sr = target_mem_read32(t, sf->regbase + FLASH_SR);
+	if ((sr & FLASH_SR_ERROR_MASK) || target_check_error(t)) {
+		DEBUG_WARN("stm32h7_flash_erase: error sr %08" PRIx32 "\n", sr);
+		target_mem_write32(t, sf->regbase + FLASH_CCR, sr & FLASH_SR_ERROR_MASK);
+		return false;
+	}
+	*done = !(sr & (FLASH_SR_BSY | FLASH_SR_QW));
+	return true;
+}
+
 static bool stm32h7_flash_write(target_flash_s *f, target_addr_t dest, const void *src, size_t len)
 {
 	target *t = f->t;
@@ -329,20 +391,6 @@ static bool stm32h7_flash_write(target_flash_s *f, target_addr_t dest, const voi
 	return true;
 }
 
-static bool stm32h7_erase_bank(target *const t, const enum align psize,
-	const uint32_t start_addr, const uint32_t reg_base)
-{
-	if (!stm32h7_flash_unlock(t, start_addr)) {
-		DEBUG_WARN("mass erase: Unlock bank failed\n");
-		return false;
-	}
-	/* BER and start can be merged (3.3.10).*/
-	const uint32_t ctrl_reg = (psize * FLASH_CR_PSIZE16) | FLASH_CR_BER | FLASH_CR_START;
-	target_mem_write32(t, reg_base + FLASH_CR, ctrl_reg);
-	DEBUG_INFO("mass erase of bank started\n");
-	return true;
-}
-
 static bool stm32h7_wait_erase_bank(target *const t, platform_timeout *timeout, const uint32_t reg_base)
 {
 	while (target_mem_read32(t, reg_base + FLASH_SR) & FLASH_SR_QW) {
@@ -373,7 +421,7 @@ static bool stm32h7_mass_erase(target *t)
 	}
 	/* Send mass erase Flash start instruction */
 	if (!stm32h7_erase_bank(t, psize, BANK1_START, FPEC1_BASE) ||
-		stm32h7_erase_bank(t, psize, BANK2_START, FPEC2_BASE))
+		!stm32h7_erase_bank(t, psize, BANK2_START, FPEC2_BASE))
 		return false;
 
 	platform_timeout timeout;
@@ -412,7 +460,8 @@ static bool stm32h7_uid(target *t, int argc, const char **argv)
 	tc_printf(t, "\n");
 	return true;
 }
-static int stm32h7_crc_bank(target *t, uint32_t bank)
+/* Run the CRC unit of the bank holding addr, crccr selects what it covers */
+static int stm32h7_crc_run(target *t, uint32_t bank, uint32_t crccr)
 {
 	uint32_t regbase = FPEC1_BASE;
 	if (bank >= BANK2_START)
@@ -422,8 +471,7 @@ static int stm32h7_crc_bank(target *t, uint32_t bank)
 			return -1;
 	uint32_t cr = FLASH_CR_CRC_EN;
 	target_mem_write32(t, regbase + FLASH_CR, cr);
-	uint32_t crccr= FLASH_CRCCR_CRC_BURST_3 |
-		FLASH_CRCCR_CLEAN_CRC | FLASH_CRCCR_ALL_BANK;
+	crccr |= FLASH_CRCCR_CRC_BURST_3 | FLASH_CRCCR_CLEAN_CRC;
 	target_mem_write32(t, regbase + FLASH_CRCCR, crccr);
 	target_mem_write32(t, regbase + FLASH_CRCCR, crccr | FLASH_CRCCR_START_CRC);
 	uint32_t sr;
@@ -443,6 +491,28 @@ static int stm32h7_crc_bank(target *t, uint32_t bank)
 	return 0;
 }
 
+static int stm32h7_crc_bank(target *t, uint32_t bank)
+{
+	return stm32h7_crc_run(t, bank, FLASH_CRCCR_ALL_BANK);
+}
+
+/* CRC of a Flash word aligned range within one bank, from the bank's CRC unit */
+static bool stm32h7_flash_crc(target_flash_s *f, target_addr_t addr, size_t len, uint32_t *crc)
+{
+	target *t = f->t;
+	struct stm32h7_flash *sf = (struct stm32h7_flash *)f;
+	if (!len || ((addr | len) & (FLASH_WORD_SIZE - 1U)) || !stm32h7_flash_unlock(t, addr))
+		return false;
+
+	/* Addresses are relative to the bank, the end one that of the last word covered */
+	target_mem_write32(t, sf->regbase + FLASH_CRCSADD, addr - f->start);
+	target_mem_write32(t, sf->regbase + FLASH_CRCEADD, addr - f->start + len - 4U);
+	if (stm32h7_crc_run(t, addr, 0))
+		return false;
+	*crc = target_mem_read32(t, FPEC1_BASE + FLASH_CRCDATA);
+	return !target_check_error(t);
+}
+
 static bool stm32h7_crc(target *t, int argc, const char **argv)
 {
 	(void)argc;
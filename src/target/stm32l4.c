@@ -574,6 +574,7 @@ static bool stm32l4_flash_busy_wait(target *t)
 	/* Read FLASH_SR to poll for BSY bit */
 	uint32_t sr;
 	do {
+		++t->flash_stats.status_polls;
 		sr = stm32l4_flash_read32(t, FLASH_SR);
 		if ((sr & FLASH_SR_ERROR_MASK) || target_check_error(t)) {
 			DEBUG_WARN("stm32l4 flash error: sr 0x%" PRIx32 "\n", sr);
@@ -21,6 +21,8 @@
 #include "general.h"
 #include "target_internal.h"
 #include "gdb_packet.h"
+#include "command.h"
+#include "crc32.h"
 
 #include <stdarg.h>
 #include <unistd.h>
@@ -31,10 +33,16 @@ target *target_list = NULL;
 
 static bool target_cmd_mass_erase(target *t, int argc, const char **argv);
 static bool target_cmd_range_erase(target *t, int argc, const char **argv);
+static bool target_cmd_mem_cache(target *t, int argc, const char **argv);
+static bool target_cmd_flash_incremental(target *t, int argc, const char **argv);
+static bool target_cmd_flash_stats(target *t, int argc, const char **argv);
 
 const struct command_s target_cmd_list[] = {
 	{"erase_mass", (cmd_handler)target_cmd_mass_erase, "Erase whole device Flash"},
 	{"erase_range", (cmd_handler)target_cmd_range_erase, "Erase a range of memory on a device"},
+	{"flash_incremental", (cmd_handler)target_cmd_flash_incremental, "Skip erasing and writing unchanged Flash blocks on load: (enable|disable)"},
+	{"flash_stats", (cmd_handler)target_cmd_flash_stats, "Show where the time of the last Flash load went"},
+	{"mem_cache", (cmd_handler)target_cmd_mem_cache, "Halted RAM read cache: (enable|disable|clear) or show statistics"},
 	{NULL, NULL, NULL}
 };
 
@@ -78,6 +86,9 @@ target *target_new(void)
 	t->halt_poll = (void*)nop_function;
 	t->halt_resume = (void*)nop_function;
 	t->check_error = (void*)false_function;
+#if PC_HOSTED == 1
+	t->mem_cache_enabled = true;
+#endif
 
 	t->target_storage = NULL;
 
@@ -108,6 +119,9 @@ void target_flash_map_free(target *t) {
 		void * next = t->flash->next;
 		if (t->flash->buf)
 			free(t->flash->buf);
+		free(t->flash->erase_pending);
+		free(t->flash->block_buf);
+		free(t->flash->cache);
 		free(t->flash);
 		t->flash = next;
 	}
@@ -135,6 +149,8 @@ void target_list_free(void)
 			target_list->commands = tc;
 		}
 		free(target_list->target_storage);
+		free(target_list->regs_cache);
+		free(target_list->mem_cache);
 		target_mem_map_free(target_list);
 		while (target_list->bw_list) {
 			void * next = target_list->bw_list->next;
@@ -182,6 +198,9 @@ target *target_attach(target *t, struct target_controller *tc)
 		t->tc->destroy_callback(t->tc, t);
 
 	t->tc = tc;
+	target_regs_cache_invalidate(t);
+	target_mem_cache_invalidate(t);
+	t->halted = false;
 	platform_target_clk_output_enable(true);
 
 	if (!t->attach(t)) {
@@ -190,6 +209,8 @@ target *target_attach(target *t, struct target_controller *tc)
 	}
 
 	t->attached = true;
+	/* Attaching leaves the core halted */
+	t->halted = true;
 	return t;
 }
 
@@ -265,6 +286,9 @@ void target_print_progress(platform_timeout *const timeout)
 /* Wrapper functions */
 void target_detach(target *t)
 {
+	target_regs_cache_invalidate(t);
+	target_mem_cache_invalidate(t);
+	t->halted = false;
 	t->detach(t);
 	platform_target_clk_output_enable(false);
 	t->attached = false;
@@ -282,18 +306,107 @@ bool target_check_error(target *t) {
 bool target_attached(target *t) { return t->attached; }
 
 /* Memory access functions */
+void target_mem_cache_invalidate(target *t)
+{
+	if (t->mem_cache)
+		t->mem_cache->valid = 0;
+}
+
+static bool target_mem_in_ram(target *t, target_addr_t addr, size_t len)
+{
+	for (struct target_ram *r = t->ram; r; r = r->next) {
+		if (addr >= r->start && addr - r->start + len <= r->length)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Only small reads of RAM on a halted target go through the cache; larger
+ * ones would just evict what GDB is likely to ask for again and gain
+ * nothing over a single block transfer.
+ */
+static bool target_mem_cacheable(target *t, target_addr_t src, size_t len)
+{
+	if (!t->mem_cache_enabled || !t->halted || !len ||
+		len > TARGET_MEM_CACHE_LINE_SIZE * TARGET_MEM_CACHE_LINES / 4U)
+		return false;
+	const target_addr_t first = src & ~(TARGET_MEM_CACHE_LINE_SIZE - 1U);
+	const target_addr_t last = (src + len - 1U) & ~(TARGET_MEM_CACHE_LINE_SIZE - 1U);
+	if (last < first || !target_mem_in_ram(t, first, last - first + TARGET_MEM_CACHE_LINE_SIZE))
+		return false;
+	if (!t->mem_cache) {
+		t->mem_cache = calloc(1, sizeof(*t->mem_cache));
+		if (!t->mem_cache) { /* calloc failed: heap exhaustion */
+			DEBUG_WARN("calloc: failed in %s\n", __func__);
+			t->mem_cache_enabled = false;
+			return false;
+		}
+	}
+	return true;
+}
+
+static int target_mem_cache_read(target *t, uint8_t *dest, target_addr_t src, size_t len)
+{
+	struct target_mem_cache *const cache = t->mem_cache;
+	while (len) {
+		const target_addr_t line_addr = src & ~(TARGET_MEM_CACHE_LINE_SIZE - 1U);
+		const size_t idx = (line_addr / TARGET_MEM_CACHE_LINE_SIZE) % TARGET_MEM_CACHE_LINES;
+		const uint32_t bit = 1U << idx;
+		if ((cache->valid & bit) && cache->tag[idx] == line_addr)
+			++cache->hits;
+		else {
+			++cache->misses;
+			cache->valid &= ~bit;
+			t->mem_read(t, cache->data[idx], line_addr, TARGET_MEM_CACHE_LINE_SIZE);
+			if (target_check_error(t))
+				return 1;
+			cache->tag[idx] = line_addr;
+			cache->valid |= bit;
+		}
+		const size_t offset = src - line_addr;
+		size_t chunk = TARGET_MEM_CACHE_LINE_SIZE - offset;
+		if (chunk > len)
+			chunk = len;
+		memcpy(dest, cache->data[idx] + offset, chunk);
+		dest += chunk;
+		src += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+/* Count the memory accesses a Flash session makes for the Flash statistics */
+static inline void target_flash_count_access(target *t)
+{
+	if (t->flash_mode)
+		++t->flash_stats.transactions;
+}
+
 int target_mem_read(target *t, void *dest, target_addr_t src, size_t len)
 {
+	if (target_mem_cacheable(t, src, len))
+		return target_mem_cache_read(t, dest, src, len);
+	target_flash_count_access(t);
 	t->mem_read(t, dest, src, len);
 	return target_check_error(t);
 }
 
 int target_mem_write(target *t, target_addr_t dest, const void *src, size_t len)
 {
+	target_mem_cache_invalidate(t);
+	target_flash_count_access(t);
 	t->mem_write(t, dest, src, len);
 	return target_check_error(t);
 }
 
+/* CRC-32 of target memory as qCRC defines it, computed on the target where it can be */
+int target_mem_crc32(target *t, uint32_t *crc, target_addr_t addr, size_t len)
+{
+	if (t->mem_crc32 && t->mem_crc32(t, addr, len, crc))
+		return 0;
+	return generic_crc32(t, crc, addr, len);
+}
 
 /* target_mem_access_needs_halt() is true if the target needs to be halted during jtag memory access */
 
@@ -305,17 +418,29 @@ bool target_mem_access_needs_halt(target *t)
 }
 
 /* Register access functions */
+void target_regs_cache_invalidate(target *t)
+{
+	t->regs_cache_valid = false;
+}
+
 ssize_t target_reg_read(target *t, int reg, void *data, size_t max)
 {
+	/* Serve the read from the cache if we know where the register lives in it */
+	if (t->regs_cache_valid && t->reg_width && reg >= 0 && max >= t->reg_width &&
+		(reg + 1U) * t->reg_width <= t->regs_size) {
+		memcpy(data, (uint8_t *)t->regs_cache + reg * t->reg_width, t->reg_width);
+		return t->reg_width;
+	}
 	return t->reg_read(t, reg, data, max);
 }
 
 ssize_t target_reg_write(target *t, int reg, const void *data, size_t size)
 {
+	target_regs_cache_invalidate(t);
 	return t->reg_write(t, reg, data, size);
 }
 
-void target_regs_read(target *t, void *data)
+static void target_regs_fetch(target *t, void *data)
 {
 	if (t->regs_read) {
 		t->regs_read(t, data);
@@ -325,8 +450,26 @@ void target_regs_read(target *t, void *data)
 		x += t->reg_read(t, i++, data + x, t->regs_size - x);
 	}
 }
+
+void target_regs_read(target *t, void *data)
+{
+	if (!t->regs_cache && t->regs_size)
+		t->regs_cache = malloc(t->regs_size);
+	if (!t->regs_cache) {
+		target_regs_fetch(t, data);
+		return;
+	}
+
+	if (!t->regs_cache_valid) {
+		target_regs_fetch(t, t->regs_cache);
+		t->regs_cache_valid = true;
+	}
+	memcpy(data, t->regs_cache, t->regs_size);
+}
+
 void target_regs_write(target *t, const void *data)
 {
+	target_regs_cache_invalidate(t);
 	if (t->regs_write) {
 		t->regs_write(t, data);
 		return;
@@ -337,14 +480,36 @@ void target_regs_write(target *t, const void *data)
 }
 
 /* Halt/resume functions */
-void target_reset(target *t) { t->reset(t); }
+void target_reset(target *t)
+{
+	target_regs_cache_invalidate(t);
+	target_mem_cache_invalidate(t);
+	/* Don't trust the cache again until a halt has been seen */
+	t->halted = false;
+	t->reset(t);
+}
+
 void target_halt_request(target *t) { t->halt_request(t); }
 enum target_halt_reason target_halt_poll(target *t, target_addr_t *watch)
 {
-	return t->halt_poll(t, watch);
+	const enum target_halt_reason reason = t->halt_poll(t, watch);
+	/* On error the target may already have been freed */
+	if (reason == TARGET_HALT_ERROR)
+		return reason;
+	t->halted = reason != TARGET_HALT_RUNNING;
+	/* Drivers may resume behind our back, e.g. to service semihosting */
+	if (!t->halted)
+		target_mem_cache_invalidate(t);
+	return reason;
 }
 
-void target_halt_resume(target *t, bool step) { t->halt_resume(t, step); }
+void target_halt_resume(target *t, bool step)
+{
+	target_regs_cache_invalidate(t);
+	target_mem_cache_invalidate(t);
+	t->halted = false;
+	t->halt_resume(t, step);
+}
 
 /* Command line for semihosting get_cmdline */
 void target_set_cmdline(target *t, char *cmdline) {
@@ -450,7 +615,63 @@ static bool target_cmd_range_erase(target *const t, const int argc, const char *
 	const uint32_t addr = strtoul(argv[1], NULL, 0);
 	const uint32_t length = strtoul(argv[2], NULL, 0);
 
-	return target_flash_erase(t, addr, length);
+	/* Deferred erases are only carried out when a load completes, so don't defer this one */
+	const bool incremental = t->flash_incremental;
+	t->flash_incremental = false;
+	bool result = target_flash_erase(t, addr, length);
+	t->flash_incremental = incremental;
+	/* Wait for any erases still running in the background and leave Flash mode */
+	result &= target_flash_complete(t);
+	return result;
+}
+
+static bool target_cmd_flash_incremental(target *const t, const int argc, const char **const argv)
+{
+	if (argc > 1 && !parse_enable_or_disable(argv[1], &t->flash_incremental))
+		return true;
+	gdb_outf("Incremental Flash loading: %s\n", t->flash_incremental ? "enabled" : "disabled");
+	return true;
+}
+
+static bool target_cmd_flash_stats(target *const t, const int argc, const char **const argv)
+{
+	(void)argc;
+	(void)argv;
+	const target_flash_stats_s *const stats = &t->flash_stats;
+	gdb_outf("Prepare %" PRIu32 " ms, erase %" PRIu32 " ms, write %" PRIu32 " ms, done %" PRIu32 " ms\n",
+		stats->prepare_ms, stats->erase_ms, stats->write_ms, stats->done_ms);
+	gdb_outf("%" PRIu32 " erases, %" PRIu32 " writes of %" PRIu32 " bytes, %" PRIu32 " blank bytes skipped, %" PRIu32
+			 " unchanged blocks skipped\n",
+		stats->erase_calls, stats->write_calls, stats->bytes_written, stats->bytes_blank, stats->blocks_unchanged);
+	gdb_outf("%" PRIu32 " memory transactions, %" PRIu32 " status polls\n", stats->transactions, stats->status_polls);
+	return true;
+}
+
+static bool target_cmd_mem_cache(target *const t, const int argc, const char **const argv)
+{
+	if (argc > 1) {
+		if (!strcmp(argv[1], "enable"))
+			t->mem_cache_enabled = true;
+		else if (!strcmp(argv[1], "disable")) {
+			t->mem_cache_enabled = false;
+			free(t->mem_cache);
+			t->mem_cache = NULL;
+		} else if (!strcmp(argv[1], "clear")) {
+			if (t->mem_cache) {
+				t->mem_cache->hits = 0;
+				t->mem_cache->misses = 0;
+			}
+		} else {
+			gdb_out("usage: monitor mem_cache [enable|disable|clear]\n");
+			return true;
+		}
+	}
+	const uint32_t hits = t->mem_cache ? t->mem_cache->hits : 0;
+	const uint32_t misses = t->mem_cache ? t->mem_cache->misses : 0;
+	gdb_outf("Memory cache %s, %u lines of %u bytes: %" PRIu32 " hits, %" PRIu32 " misses\n",
+		t->mem_cache_enabled ? "enabled" : "disabled", TARGET_MEM_CACHE_LINES, TARGET_MEM_CACHE_LINE_SIZE,
+		hits, misses);
+	return true;
 }
 
 /* Accessor functions */
@@ -487,36 +708,45 @@ unsigned int target_part_id(target *t)
 uint32_t target_mem_read32(target *t, uint32_t addr)
 {
 	uint32_t ret;
+	target_flash_count_access(t);
 	t->mem_read(t, &ret, addr, sizeof(ret));
 	return ret;
 }
 
 void target_mem_write32(target *t, uint32_t addr, uint32_t value)
 {
+	target_mem_cache_invalidate(t);
+	target_flash_count_access(t);
 	t->mem_write(t, addr, &value, sizeof(value));
 }
 
 uint16_t target_mem_read16(target *t, uint32_t addr)
 {
 	uint16_t ret;
+	target_flash_count_access(t);
 	t->mem_read(t, &ret, addr, sizeof(ret));
 	return ret;
 }
 
 void target_mem_write16(target *t, uint32_t addr, uint16_t value)
 {
+	target_mem_cache_invalidate(t);
+	target_flash_count_access(t);
 	t->mem_write(t, addr, &value, sizeof(value));
 }
 
 uint8_t target_mem_read8(target *t, uint32_t addr)
 {
 	uint8_t ret;
+	target_flash_count_access(t);
 	t->mem_read(t, &ret, addr, sizeof(ret));
 	return ret;
 }
 
 void target_mem_write8(target *t, uint32_t addr, uint8_t value)
 {
+	target_mem_cache_invalidate(t);
+	target_flash_count_access(t);
 	t->mem_write(t, addr, &value, sizeof(value));
 }
 
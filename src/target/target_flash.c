@@ -37,6 +37,55 @@
 
 #include "general.h"
 #include "target_internal.h"
+#include "crc32.h"
+#if PC_HOSTED == 1
+#include "flash_cache.h"
+#else
+/* Only the hosted build keeps a cache of what was last programmed */
+static inline void flash_cache_open(target_flash_s *f)
+{
+	(void)f;
+}
+
+static inline bool flash_cache_lookup(target_flash_s *f, target_addr_t addr, const uint8_t *data, bool *matches)
+{
+	(void)f;
+	(void)addr;
+	(void)data;
+	(void)matches;
+	return false;
+}
+
+static inline void flash_cache_update(target_flash_s *f, target_addr_t addr, const uint8_t *data)
+{
+	(void)f;
+	(void)addr;
+	(void)data;
+}
+
+static inline void flash_cache_forget(target_flash_s *f, target_addr_t addr)
+{
+	(void)f;
+	(void)addr;
+}
+
+static inline void flash_cache_close(target_flash_s *f, bool success)
+{
+	(void)f;
+	(void)success;
+}
+#endif
+
+/*
+ * Largest erase block the incremental mode will stage in memory; bigger blocks
+ * are erased and written as usual. The probe firmware has little RAM to spare.
+ */
+#if PC_HOSTED == 1
+#define FLASH_INCREMENTAL_MAX_BLOCK (256U * 1024U)
+#else
+#define FLASH_INCREMENTAL_MAX_BLOCK 4096U
+#endif
+#define FLASH_COMPARE_CHUNK 256U
 
 target_flash_s *target_flash_for_addr(target *t, uint32_t addr)
 {
@@ -60,8 +109,10 @@ static bool target_enter_flash_mode(target *t)
 		/* This saves us if we're interrupted in IRQ context */
 		target_reset(t);
 
-	if (ret == true)
+	if (ret == true) {
 		t->flash_mode = true;
+		memset(&t->flash_stats, 0, sizeof(t->flash_stats));
+	}
 
 	return ret;
 }
@@ -89,8 +140,10 @@ static bool flash_prepare(target_flash_s *f)
 		return true;
 
 	bool ret = true;
+	const uint32_t start_time = platform_time_ms();
 	if (f->prepare)
 		ret = f->prepare(f);
+	f->t->flash_stats.prepare_ms += platform_time_ms() - start_time;
 
 	if (ret == true)
 		f->ready = true;
@@ -98,18 +151,85 @@ static bool flash_prepare(target_flash_s *f)
 	return ret;
 }
 
+static bool flash_erase_busy(const target_flash_s *f)
+{
+	return f->erase_running || f->erase_len;
+}
+
+/* Advance a background erase, starting its next part once the last one is done */
+static bool flash_erase_service(target_flash_s *f)
+{
+	if (f->erase_running) {
+		bool done = false;
+		++f->t->flash_stats.status_polls;
+		if (!f->erase_poll(f, &done))
+			goto failed;
+		if (!done)
+			return true;
+		f->erase_running = false;
+	}
+	if (!f->erase_len)
+		return true;
+
+	++f->t->flash_stats.erase_calls;
+	size_t started = f->erase_start(f, f->erase_addr, f->erase_len);
+	if (!started)
+		goto failed;
+	started = MIN(started, f->erase_len);
+	f->erase_addr += started;
+	f->erase_len -= started;
+	f->erase_running = true;
+	return true;
+
+failed:
+	DEBUG_WARN("Erase failed at %" PRIx32 "\n", f->erase_addr);
+	f->erase_running = false;
+	f->erase_len = 0;
+	f->erase_failed = true;
+	return false;
+}
+
+/* Keep the background erases of all Flashes moving */
+static void flash_erase_service_all(target *t)
+{
+	for (target_flash_s *f = t->flash; f; f = f->next) {
+		if (flash_erase_busy(f))
+			flash_erase_service(f);
+	}
+}
+
+/* Wait for this Flash's background erase to complete, the others keep going meanwhile */
+static bool flash_erase_wait(target_flash_s *f)
+{
+	platform_timeout timeout;
+	platform_timeout_set(&timeout, 500);
+	const uint32_t start_time = platform_time_ms();
+	while (flash_erase_busy(f)) {
+		flash_erase_service_all(f->t);
+		target_print_progress(&timeout);
+	}
+	f->t->flash_stats.erase_ms += platform_time_ms() - start_time;
+	const bool failed = f->erase_failed;
+	f->erase_failed = false;
+	return !failed;
+}
+
 static bool flash_done(target_flash_s *f)
 {
 	if (!f->ready)
 		return true;
 
-	bool ret = true;
+	bool ret = flash_erase_wait(f);
+	ret &= flash_loader_stop(f);
+	const uint32_t start_time = platform_time_ms();
 	if (f->done)
-		ret = f->done(f);
+		ret &= f->done(f);
+	f->t->flash_stats.done_ms += platform_time_ms() - start_time;
 
 	if (f->buf) {
 		free(f->buf);
 		f->buf = NULL;
+		f->buf_dirty = NULL;
 	}
 
 	f->ready = false;
@@ -117,11 +237,148 @@ static bool flash_done(target_flash_s *f)
 	return ret;
 }
 
+static size_t flash_block_index(const target_flash_s *f, target_addr_t addr)
+{
+	return (addr - f->start) / f->blocksize;
+}
+
+static void flash_block_set_pending(target_flash_s *f, target_addr_t addr)
+{
+	const size_t idx = flash_block_index(f, addr);
+	f->erase_pending[idx / 8U] |= 1U << (idx % 8U);
+}
+
+static void flash_block_clear_pending(target_flash_s *f, target_addr_t addr)
+{
+	const size_t idx = flash_block_index(f, addr);
+	f->erase_pending[idx / 8U] &= ~(1U << (idx % 8U));
+}
+
+static bool flash_block_is_pending(const target_flash_s *f, target_addr_t addr)
+{
+	const size_t idx = flash_block_index(f, addr);
+	return f->erase_pending[idx / 8U] & (1U << (idx % 8U));
+}
+
+/* Set up deferred erasing for this Flash, false if blocks have to be erased straight away */
+static bool flash_incremental_prepare(target_flash_s *f)
+{
+	if (f->erase_pending)
+		return true;
+	if (f->blocksize > FLASH_INCREMENTAL_MAX_BLOCK)
+		return false;
+
+	const size_t blocks = f->length / f->blocksize;
+	f->erase_pending = calloc((blocks + 7U) / 8U, 1);
+	f->block_buf = malloc(f->blocksize);
+	if (!f->erase_pending || !f->block_buf) { /* malloc failed: heap exhaustion */
+		DEBUG_WARN("malloc: failed in %s\n", __func__);
+		free(f->erase_pending);
+		free(f->block_buf);
+		f->erase_pending = NULL;
+		f->block_buf = NULL;
+		return false;
+	}
+	f->block_addr = UINT32_MAX;
+	flash_cache_open(f);
+	return true;
+}
+
+/* Compare a block of the target's Flash against the given contents */
+static bool flash_block_matches(target_flash_s *f, target_addr_t addr, const uint8_t *data)
+{
+	uint8_t chunk[FLASH_COMPARE_CHUNK];
+	for (size_t offset = 0; offset < f->blocksize; offset += sizeof(chunk)) {
+		const size_t len = MIN(sizeof(chunk), f->blocksize - offset);
+		if (target_mem_read(f->t, chunk, addr + offset, len) || memcmp(chunk, data + offset, len))
+			return false;
+	}
+	return true;
+}
+
+/* Check whether a block holds data, from the cache when it knows, and record it will */
+static bool flash_block_unchanged(target_flash_s *f, target_addr_t addr, const uint8_t *data)
+{
+	bool matches;
+	if (!flash_cache_lookup(f, addr, data, &matches))
+		matches = flash_block_matches(f, addr, data);
+	flash_cache_update(f, addr, data);
+	return matches;
+}
+
+/*
+ * Erase a block aligned range within one Flash using the fewest commands the driver
+ * offers: a background erase if it has one, otherwise runs of up to erase_max.
+ */
+static bool flash_erase_range(target_flash_s *f, target_addr_t addr, size_t len)
+{
+	/* Whatever the loader still has queued must be programmed before erasing */
+	if (!flash_loader_stop(f))
+		return false;
+
+	if (f->erase_start && f->erase_poll) {
+		/* Queue the range behind the running erase if it follows on, and let it run in the background */
+		if (flash_erase_busy(f) && f->erase_addr + f->erase_len == addr)
+			f->erase_len += len;
+		else {
+			if (!flash_erase_wait(f))
+				return false;
+			f->erase_addr = addr;
+			f->erase_len = len;
+		}
+		return flash_erase_service(f);
+	}
+
+	bool ret = true;
+	const uint32_t start_time = platform_time_ms();
+	const size_t step = MAX(f->erase_max, f->blocksize);
+	while (len) {
+		const size_t chunk = MIN(step, len);
+		++f->t->flash_stats.erase_calls;
+		if (!f->erase(f, addr, chunk)) {
+			DEBUG_WARN("Erase failed at %" PRIx32 "\n", addr);
+			ret = false;
+			break;
+		}
+		addr += chunk;
+		len -= chunk;
+	}
+	f->t->flash_stats.erase_ms += platform_time_ms() - start_time;
+	return ret;
+}
+
+/* True if the range covers every Flash and they can all be erased in one go */
+static bool flash_erase_covers_all(target *t, target_addr_t addr, size_t len)
+{
+	if (!t->mass_erase || !t->flash)
+		return false;
+	for (target_flash_s *f = t->flash; f; f = f->next) {
+		if (!f->in_mass_erase || f->start < addr || f->start - addr + f->length > len)
+			return false;
+	}
+	return true;
+}
+
 bool target_flash_erase(target *t, target_addr_t addr, size_t len)
 {
+	/* Flash drivers stage data and stubs in RAM behind the memory cache */
+	target_mem_cache_invalidate(t);
 	if (!target_enter_flash_mode(t))
 		return false;
 
+	if (!t->flash_incremental && flash_erase_covers_all(t, addr, len)) {
+		DEBUG_INFO("Erase covers all Flash, using mass erase\n");
+		for (target_flash_s *f = t->flash; f; f = f->next) {
+			if (!flash_erase_wait(f) || !flash_loader_stop(f))
+				return false;
+		}
+		const uint32_t start_time = platform_time_ms();
+		++t->flash_stats.erase_calls;
+		const bool ret = t->mass_erase(t);
+		t->flash_stats.erase_ms += platform_time_ms() - start_time;
+		return ret;
+	}
+
 	target_flash_s *active_flash = target_flash_for_addr(t, addr);
 	bool ret = true; /* Catch false returns with &= */
 	while (len) {
@@ -131,67 +388,102 @@ bool target_flash_erase(target *t, target_addr_t addr, size_t len)
 			return false;
 		}
 
-		/* Terminate flash operations if we're not in the same target flash */
+		/* Terminate flash operations if we're not in the same target flash, unless it is still erasing */
 		if (f != active_flash) {
-			ret &= flash_done(active_flash);
+			if (!flash_erase_busy(active_flash))
+				ret &= flash_done(active_flash);
 			active_flash = f;
 		}
 
+		/* Take all the blocks of the request that lie in this Flash at once */
 		const target_addr_t local_start_addr = addr & ~(f->blocksize - 1U);
-		const target_addr_t local_end_addr = local_start_addr + f->blocksize;
-
-		if (!flash_prepare(f))
-			return false;
-
-		ret &= f->erase(f, local_start_addr, f->blocksize);
-		if (!ret) {
-			DEBUG_WARN("Erase failed at %" PRIx32 "\n", local_start_addr);
-			break;
+		const target_addr_t local_end_addr = addr - f->start + len < f->length ?
+			ALIGN(addr + len, f->blocksize) : f->start + f->length;
+
+		if (t->flash_incremental && flash_incremental_prepare(f)) {
+			/* Decide whether blocks really need erasing once their new contents are known */
+			for (target_addr_t block = local_start_addr; block < local_end_addr; block += f->blocksize)
+				flash_block_set_pending(f, block);
+		} else {
+			if (!flash_prepare(f))
+				return false;
+			ret &= flash_erase_range(f, local_start_addr, local_end_addr - local_start_addr);
 		}
+		if (!ret)
+			break;
 
 		len -= MIN(local_end_addr - addr, len);
 		addr = local_end_addr;
 	}
-	/* Issue flash done on last operation */
-	ret &= flash_done(active_flash);
+	/* Issue flash done on last operation, background erases get theirs once complete */
+	if (!flash_erase_busy(active_flash))
+		ret &= flash_done(active_flash);
 	return ret;
 }
 
+static size_t flash_buffer_chunks(const target_flash_s *f)
+{
+	return f->writebufsize / f->writesize;
+}
+
 bool flash_buffer_alloc(target_flash_s *flash)
 {
-	/* Allocate buffer */
-	flash->buf = malloc(flash->writebufsize);
+	/* Allocate buffer, followed by its dirty chunk bitmap */
+	const size_t bitmap_size = (flash_buffer_chunks(flash) + 7U) / 8U;
+	flash->buf = malloc(flash->writebufsize + bitmap_size);
 	if (!flash->buf) { /* malloc failed: heap exhaustion */
 		DEBUG_WARN("malloc: failed in %s\n", __func__);
 		return false;
 	}
+	flash->buf_dirty = (uint8_t *)flash->buf + flash->writebufsize;
+	memset(flash->buf_dirty, 0, bitmap_size);
 	flash->buf_addr_base = UINT32_MAX;
-	flash->buf_addr_low = UINT32_MAX;
-	flash->buf_addr_high = 0;
+	return true;
+}
+
+static bool flash_chunk_is_blank(const target_flash_s *f, const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		if (data[i] != f->erased)
+			return false;
+	}
 	return true;
 }
 
 static bool flash_buffered_flush(target_flash_s *f)
 {
 	bool ret = true; /* Catch false returns with &= */
-	if (f->buf && f->buf_addr_base != UINT32_MAX && f->buf_addr_low != UINT32_MAX &&
-		f->buf_addr_low < f->buf_addr_high) {
-		/* Write buffer to flash */
+	if (f->buf && f->buf_addr_base != UINT32_MAX) {
+		/* Write the chunks of the buffer that were written to, holes stay untouched */
 
-		if (!flash_prepare(f))
+		if (!flash_prepare(f) || !flash_erase_wait(f))
 			return false;
 
-		target_addr_t aligned_addr = f->buf_addr_low & ~(f->writesize - 1U);
-
-		const uint8_t *src = f->buf + (aligned_addr - f->buf_addr_base);
-		uint32_t len = f->buf_addr_high - aligned_addr;
-
-		for (size_t offset = 0; offset < len; offset += f->writesize)
-			ret &= f->write(f, aligned_addr + offset, src + offset, f->writesize);
+		const uint8_t *src = f->buf;
+		target_flash_stats_s *const stats = &f->t->flash_stats;
+		const uint32_t start_time = platform_time_ms();
+
+		for (size_t chunk = 0; chunk < flash_buffer_chunks(f); ++chunk) {
+			if (!(f->buf_dirty[chunk / 8U] & (1U << (chunk % 8U))))
+				continue;
+			flash_erase_service_all(f->t);
+			const size_t offset = chunk * f->writesize;
+			/* Programming the erased value changes nothing, so leave padding alone */
+			if (flash_chunk_is_blank(f, src + offset, f->writesize)) {
+				stats->bytes_blank += f->writesize;
+				continue;
+			}
+			++stats->write_calls;
+			stats->bytes_written += f->writesize;
+			if (f->loader)
+				ret &= flash_loader_write(f, f->buf_addr_base + offset, src + offset, f->writesize);
+			else
+				ret &= f->write(f, f->buf_addr_base + offset, src + offset, f->writesize);
+		}
+		stats->write_ms += platform_time_ms() - start_time;
 
 		f->buf_addr_base = UINT32_MAX;
-		f->buf_addr_low = UINT32_MAX;
-		f->buf_addr_high = 0;
+		memset(f->buf_dirty, 0, (flash_buffer_chunks(f) + 7U) / 8U);
 	}
 
 	return ret;
@@ -209,18 +501,78 @@ static bool flash_buffered_write(target_flash_s *f, target_addr_t dest, const vo
 
 			/* Setup buffer */
 			f->buf_addr_base = base_addr;
-			memset(f->buf, f->erased, f->writebufsize);
 		}
 
 		const size_t offset = dest % f->writebufsize;
 		const size_t local_len = MIN(f->writebufsize - offset, len);
 
+		/* Pad chunks with the erased value as they are first written to */
+		for (size_t chunk = offset / f->writesize; chunk <= (offset + local_len - 1U) / f->writesize; ++chunk) {
+			if (f->buf_dirty[chunk / 8U] & (1U << (chunk % 8U)))
+				continue;
+			memset(f->buf + chunk * f->writesize, f->erased, f->writesize);
+			f->buf_dirty[chunk / 8U] |= 1U << (chunk % 8U);
+		}
+
 		/* Copy chunk into sector buffer */
 		memcpy(f->buf + offset, src, local_len);
 
-		/* This allows for writes smaller than writebufsize when flushing in the future */
-		f->buf_addr_low = MIN(f->buf_addr_low, dest);
-		f->buf_addr_high = MAX(f->buf_addr_high, dest + local_len);
+		dest += local_len;
+		src += local_len;
+		len -= local_len;
+	}
+	return ret;
+}
+
+/* Erase and write the staged block, unless the target already holds exactly that */
+static bool flash_incremental_commit(target_flash_s *f)
+{
+	if (f->block_addr == UINT32_MAX)
+		return true;
+	const target_addr_t addr = f->block_addr;
+	f->block_addr = UINT32_MAX;
+	flash_block_clear_pending(f, addr);
+	if (!flash_erase_wait(f))
+		return false;
+
+	if (flash_block_unchanged(f, addr, f->block_buf)) {
+		++f->t->flash_stats.blocks_unchanged;
+		return true;
+	}
+
+	if (!flash_prepare(f) || !flash_erase_range(f, addr, f->blocksize))
+		return false;
+	if (!f->buf && !flash_buffer_alloc(f))
+		return false;
+	return flash_buffered_write(f, addr, f->block_buf, f->blocksize) && flash_buffered_flush(f);
+}
+
+/*
+ * Stage writes to blocks with a deferred erase until the write moves on to another
+ * block. GDB sorts its Flash writes by address, so a block is complete by then.
+ */
+static bool flash_incremental_write(target_flash_s *f, target_addr_t dest, const uint8_t *src, size_t len)
+{
+	bool ret = true; /* Catch false returns with &= */
+	while (len) {
+		const target_addr_t block_addr = dest & ~(f->blocksize - 1U);
+		const size_t offset = dest - block_addr;
+		const size_t local_len = MIN(f->blocksize - offset, len);
+
+		if (block_addr != f->block_addr) {
+			ret &= flash_incremental_commit(f);
+			if (flash_block_is_pending(f, block_addr)) {
+				f->block_addr = block_addr;
+				memset(f->block_buf, f->erased, f->blocksize);
+			}
+		}
+
+		if (block_addr == f->block_addr)
+			memcpy(f->block_buf + offset, src, local_len);
+		else {
+			flash_cache_forget(f, block_addr);
+			ret &= flash_buffered_write(f, dest, src, local_len);
+		}
 
 		dest += local_len;
 		src += local_len;
@@ -229,18 +581,46 @@ static bool flash_buffered_write(target_flash_s *f, target_addr_t dest, const vo
 	return ret;
 }
 
+/* Commit the last staged block and carry out deferred erases nothing was written to */
+static bool flash_incremental_finish(target_flash_s *f)
+{
+	if (!f->erase_pending)
+		return true;
+
+	bool ret = flash_incremental_commit(f) && flash_erase_wait(f);
+	memset(f->block_buf, f->erased, f->blocksize);
+	for (target_addr_t addr = f->start; ret && addr < f->start + f->length; addr += f->blocksize) {
+		if (!flash_block_is_pending(f, addr))
+			continue;
+		if (flash_block_unchanged(f, addr, f->block_buf))
+			++f->t->flash_stats.blocks_unchanged;
+		else if (!flash_prepare(f) || !flash_erase_range(f, addr, f->blocksize))
+			ret = false;
+	}
+
+	free(f->erase_pending);
+	free(f->block_buf);
+	f->erase_pending = NULL;
+	f->block_buf = NULL;
+	return ret;
+}
+
 bool target_flash_write(target *t, target_addr_t dest, const void *src, size_t len)
 {
+	target_mem_cache_invalidate(t);
 	if (!target_enter_flash_mode(t))
 		return false;
 
 	bool ret = true; /* Catch false returns with &= */
 	target_flash_s *active_flash = NULL;
+	flash_erase_service_all(t);
 
 	for (target_flash_s *f = t->flash; f; f = f->next) {
 		if (f->start <= dest && dest < f->start + f->length)
 			active_flash = f;
 		else if (f->buf) {
+			if (f->erase_pending)
+				ret &= flash_incremental_commit(f);
 			ret &= flash_buffered_flush(f);
 			ret &= flash_done(f);
 		}
@@ -255,6 +635,8 @@ bool target_flash_write(target *t, target_addr_t dest, const void *src, size_t l
 
 		/* Terminate flash operations if we're not in the same target flash */
 		if (f != active_flash) {
+			if (active_flash->erase_pending)
+				ret &= flash_incremental_commit(active_flash);
 			ret &= flash_buffered_flush(active_flash);
 			ret &= flash_done(active_flash);
 			active_flash = f;
@@ -269,7 +651,10 @@ bool target_flash_write(target *t, target_addr_t dest, const void *src, size_t l
 		const target_addr_t local_end_addr = MIN(dest + len, f->start + f->length);
 		const target_addr_t local_length = local_end_addr - dest;
 
-		ret &= flash_buffered_write(f, dest, src, local_length);
+		if (f->erase_pending)
+			ret &= flash_incremental_write(f, dest, src, local_length);
+		else
+			ret &= flash_buffered_write(f, dest, src, local_length);
 		if (!ret) {
 			DEBUG_WARN("Write failed at %" PRIx32 "\n", dest);
 			break;
@@ -289,10 +674,63 @@ bool target_flash_complete(target *t)
 
 	bool ret = true; /* Catch false returns with &= */
 	for (target_flash_s *f = t->flash; f; f = f->next) {
+		ret &= flash_incremental_finish(f);
 		ret &= flash_buffered_flush(f);
 		ret &= flash_done(f);
+		flash_cache_close(f, ret);
 	}
+	if (t->flash_stats.blocks_unchanged)
+		DEBUG_INFO("Incremental flash: %" PRIu32 " unchanged blocks skipped\n", t->flash_stats.blocks_unchanged);
+	if (t->flash_stats.bytes_blank)
+		DEBUG_INFO("Flash: %" PRIu32 " blank bytes not programmed\n", t->flash_stats.bytes_blank);
 
 	target_exit_flash_mode(t);
+	target_mem_cache_invalidate(t);
 	return ret;
 }
+
+/* The CRC a Flash controller's CRC unit gives for data: each little endian word fed in MSB first */
+static uint32_t flash_crc32_words(const uint8_t *data, size_t len)
+{
+	uint32_t crc = 0xffffffffU;
+	for (size_t offset = 0; offset < len; offset += 4U) {
+		const uint8_t word[4] = {data[offset + 3U], data[offset + 2U], data[offset + 1U], data[offset]};
+		crc = crc32_update(crc, word, sizeof(word));
+	}
+	return crc;
+}
+
+/*
+ * Check the target's memory holds the given data by comparing CRCs rather than
+ * reading it back: from the Flash controller's CRC unit where the driver offers
+ * one, otherwise computed on the target or, failing that, by the probe.
+ */
+bool target_flash_verify(target *t, target_addr_t addr, const void *data, size_t len)
+{
+	const uint8_t *src = data;
+	while (len) {
+		target_flash_s *f = target_flash_for_addr(t, addr);
+		const size_t local_len = f ? MIN(len, f->start + f->length - addr) : len;
+		uint32_t crc;
+		if (f && f->crc && !(local_len & 3U) && f->crc(f, addr, local_len, &crc)) {
+			if (crc != flash_crc32_words(src, local_len))
+				return false;
+		} else if (target_mem_crc32(t, &crc, addr, local_len) || crc != crc32_update(0xffffffffU, src, local_len))
+			return false;
+
+		addr += local_len;
+		src += local_len;
+		len -= local_len;
+	}
+	return true;
+}
+
+void target_flash_set_incremental(target *t, bool enable)
+{
+	t->flash_incremental = enable;
+}
+
+const target_flash_stats_s *target_flash_stats(target *t)
+{
+	return &t->flash_stats;
+}
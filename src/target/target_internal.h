@@ -38,6 +38,23 @@ typedef bool (*flash_prepare_func)(target_flash_s *f);
 typedef bool (*flash_erase_func)(target_flash_s *f, target_addr_t addr, size_t len);
 typedef bool (*flash_write_func)(target_flash_s *f, target_addr_t dest, const void *src, size_t len);
 typedef bool (*flash_done_func)(target_flash_s *f);
+typedef size_t (*flash_erase_start_func)(target_flash_s *f, target_addr_t addr, size_t len);
+typedef bool (*flash_erase_poll_func)(target_flash_s *f, bool *done);
+typedef bool (*flash_crc_func)(target_flash_s *f, target_addr_t addr, size_t len, uint32_t *crc);
+
+/*
+ * Optional on-target Flash loader. The stub is entered with r0 pointing at its
+ * mailbox and r1 = arg, and programs the buffers of a RAM ring while the probe
+ * keeps filling the next ones, see flash_loader.c for the layout.
+ */
+typedef struct flash_loader {
+	const uint16_t *stub;      /* Thumb code of the loader */
+	size_t stub_size;          /* size of the loader code in bytes */
+	target_addr_t ram_base;    /* RAM holding the stub, its mailbox and the ring */
+	size_t buffer_size;        /* bytes per ring buffer, a multiple of 4 */
+	size_t buffer_count;       /* buffers in the ring, a power of two and at least 2 */
+	uint32_t arg;              /* handed to the stub, e.g. the Flash controller base */
+} flash_loader_s;
 
 struct target_flash {
 	target *t;                   /* Target this flash is attached to */
@@ -50,12 +67,38 @@ struct target_flash {
 	bool ready;                  /* true if flash is in flash mode/prepared */
 	flash_prepare_func prepare;  /* prepare for flash operations */
 	flash_erase_func erase;      /* erase a range of flash */
+	size_t erase_max;            /* optional: largest block aligned range erase() takes in one call */
+	bool in_mass_erase;          /* optional: the target's mass_erase also erases this flash */
+	/*
+	 * Optional, for banks with their own controller: start erasing at addr without
+	 * waiting, returning how many bytes of len that covers (0 on failure), and poll
+	 * for that to finish. Lets the erase of one bank run while another is written.
+	 */
+	flash_erase_start_func erase_start;
+	flash_erase_poll_func erase_poll;
+	target_addr_t erase_addr;    /* next address of the queued background erase */
+	size_t erase_len;            /* bytes of the background erase still to be started */
+	bool erase_running;          /* a background erase is in progress */
+	bool erase_failed;           /* a background erase failed, reported by the next wait */
 	flash_write_func write;      /* write to flash */
 	flash_done_func done;        /* finish flash operations */
+	/*
+	 * Optional: have the Flash controller compute the CRC-32 of a range, returning false
+	 * if it can't so the caller falls back to other means. The CRC is that of the STM32
+	 * CRC unit: each little endian 32-bit word fed in MSB first, len a multiple of 4.
+	 */
+	flash_crc_func crc;
 	void *buf;                   /* buffer for flash operations */
 	target_addr_t buf_addr_base; /* address of block this buffer is for */
-	target_addr_t buf_addr_low;  /* address of lowest byte written */
-	target_addr_t buf_addr_high; /* address of highest byte written */
+	uint8_t *buf_dirty;          /* bitmap of the buffer's writesize chunks holding data, allocated with buf */
+	uint8_t *erase_pending;      /* incremental mode: bitmap of blocks with a deferred erase */
+	uint8_t *block_buf;          /* incremental mode: new contents of the block being staged */
+	target_addr_t block_addr;    /* address of the staged block, UINT32_MAX if none */
+	struct flash_cache *cache;   /* hosted incremental mode: CRCs of the blocks as last programmed */
+	const flash_loader_s *loader; /* optional: stream writes through an on-target loader */
+	bool loader_running;         /* the loader is running on the target */
+	bool loader_failed;          /* the loader would not start, write directly from now on */
+	uint32_t loader_queued;      /* buffers handed to the running loader */
 	target_flash_s *next;        /* next flash in list */
 };
 
@@ -73,6 +116,18 @@ struct target_command_s {
 	struct target_command_s *next;
 };
 
+/* Halted-state memory read cache, direct mapped over the target's RAM regions */
+#define TARGET_MEM_CACHE_LINES     16U
+#define TARGET_MEM_CACHE_LINE_SIZE 64U
+
+struct target_mem_cache {
+	uint32_t valid; /* Bitmask of lines holding data */
+	target_addr_t tag[TARGET_MEM_CACHE_LINES];
+	uint8_t data[TARGET_MEM_CACHE_LINES][TARGET_MEM_CACHE_LINE_SIZE];
+	uint32_t hits;
+	uint32_t misses;
+};
+
 struct breakwatch {
 	struct breakwatch *next;
 	enum target_breakwatch type;
@@ -95,6 +150,12 @@ struct target_s {
 	/* Memory access functions */
 	void (*mem_read)(target *t, void *dest, target_addr_t src, size_t len);
 	void (*mem_write)(target *t, target_addr_t dest, const void *src, size_t len);
+	/* Optional: CRC-32 of memory as qCRC defines it computed on the halted target, false if it can't */
+	bool (*mem_crc32)(target *t, target_addr_t addr, size_t len, uint32_t *crc);
+	/* RAM read cache, only used while the target is known to be halted */
+	struct target_mem_cache *mem_cache;
+	bool mem_cache_enabled;
+	bool halted;
 
 	/* Register access functions */
 	size_t regs_size;
@@ -103,6 +164,10 @@ struct target_s {
 	void (*regs_write)(target *t, const void *data);
 	ssize_t (*reg_read)(target *t, int reg, void *data, size_t max);
 	ssize_t (*reg_write)(target *t, int reg, const void *data, size_t size);
+	/* Register cache, filled by target_regs_read() while halted */
+	void *regs_cache;
+	bool regs_cache_valid;
+	size_t reg_width; /* Width of every register in the regs_read() block, 0 if they vary */
 
 	/* Halt/resume functions */
 	void (*reset)(target *t);
@@ -123,6 +188,8 @@ struct target_s {
 	bool (*enter_flash_mode)(target *t);
 	bool (*exit_flash_mode)(target *t);
 	bool flash_mode;
+	bool flash_incremental;           /* Skip erasing and writing blocks whose contents are unchanged */
+	target_flash_stats_s flash_stats;
 
 	/* target-defined options */
 	unsigned target_options;
@@ -167,6 +234,10 @@ void target_mem_map_free(target *t);
 void target_add_commands(target *t, const struct command_s *cmds, const char *name);
 void target_add_ram(target *t, target_addr_t start, uint32_t len);
 void target_add_flash(target *t, target_flash_s *f);
+void target_regs_cache_invalidate(target *t);
+void target_mem_cache_invalidate(target *t);
+bool flash_loader_write(target_flash_s *f, target_addr_t dest, const void *src, size_t len);
+bool flash_loader_stop(target_flash_s *f);
 
 target_flash_s *target_flash_for_addr(target *t, uint32_t addr);
 